@@ -27,7 +27,11 @@ let package = Package(
             name: "html2md_cpp",
             path: ".",
             sources: [
+                "src/batch_converter.cpp",
                 "src/html2md.cpp",
+                "src/parallel_convert.cpp",
+                "src/sink.cpp",
+                "src/structural_index.cpp",
                 "src/table.cpp",
             ],
             publicHeadersPath: "include",
@@ -0,0 +1,225 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "file_utils.h"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+namespace {
+struct Job {
+  fs::path input;
+  fs::path output;
+};
+
+// Keeps the messages of different threads on separate lines
+std::mutex report_mutex;
+
+void report(const fs::path &file, const string &message) {
+  std::lock_guard<std::mutex> lock(report_mutex);
+  std::cerr << file.string() << ": " << message << std::endl;
+}
+
+bool isHtmlFile(const fs::path &path) {
+  string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  return extension == ".html" || extension == ".htm" || extension == ".xhtml";
+}
+
+// `relative` is the path of the input below the directory it was found in
+fs::path outputFor(const fs::path &input, const fs::path &relative,
+                   const string &outputDir) {
+  fs::path output = outputDir.empty() ? input : fs::path(outputDir) / relative;
+
+  // Never overwrite the input
+  if (output.extension() == ".md")
+    output += ".md";
+  else
+    output.replace_extension(".md");
+
+  return output;
+}
+
+// The path as the file system sees it, so `a/../x.md` and `x.md` are the same
+string pathKey(const fs::path &path) {
+  std::error_code error;
+  fs::path normal = fs::weakly_canonical(path, error);
+  if (error)
+    normal = path.lexically_normal();
+
+  return normal.string();
+}
+
+// Removes the jobs that would write the same file as an earlier one or
+// overwrite one of the inputs. Returns the number of removed jobs.
+size_t removeConflicts(vector<Job> *jobs) {
+  std::unordered_map<string, const Job *> inputs;
+  for (const auto &job : *jobs)
+    inputs.emplace(pathKey(job.input), &job);
+
+  std::unordered_map<string, const Job *> outputs;
+  vector<Job> kept;
+  size_t removed = 0;
+
+  for (const auto &job : *jobs) {
+    string output = pathKey(job.output);
+
+    // Only kept jobs claim their output, a removed one writes nothing
+    auto written = outputs.find(output);
+
+    if (inputs.count(output) != 0) {
+      report(job.input, "Output " + job.output.string() + " is also an input");
+    } else if (written != outputs.end()) {
+      report(job.input, "Same output as " + written->second->input.string() +
+                            ": " + job.output.string());
+    } else {
+      outputs.emplace(output, &job);
+      kept.push_back(job);
+      continue;
+    }
+
+    ++removed;
+  }
+
+  *jobs = std::move(kept);
+  return removed;
+}
+
+// Returns the number of inputs that couldn't be read or converted
+size_t collect(const Batch::Options &options, vector<Job> *jobs) {
+  size_t failed = 0;
+
+  for (const auto &input : options.inputs) {
+    if (input == "-") {
+      report(input, "Standard input can only be converted on its own");
+      ++failed;
+      continue;
+    }
+
+    std::error_code error;
+    fs::file_status status = fs::status(input, error);
+
+    if (!fs::exists(status)) {
+      report(input, "No such file or directory");
+      ++failed;
+      continue;
+    }
+
+    if (!fs::is_directory(status)) {
+      fs::path name = fs::path(input).filename();
+      jobs->push_back({input, outputFor(input, name, options.outputDir)});
+      continue;
+    }
+
+    if (!options.recursive) {
+      report(input, "Is a directory, use -R to convert the files in it");
+      ++failed;
+      continue;
+    }
+
+    fs::recursive_directory_iterator it(
+        input, fs::directory_options::skip_permission_denied, error);
+    for (; !error && it != fs::recursive_directory_iterator();
+         it.increment(error)) {
+      std::error_code file_error;
+      if (!it->is_regular_file(file_error) || !isHtmlFile(it->path()))
+        continue;
+
+      jobs->push_back({it->path(),
+                       outputFor(it->path(),
+                                 it->path().lexically_relative(input),
+                                 options.outputDir)});
+    }
+
+    if (error) {
+      report(input, error.message());
+      ++failed;
+    }
+  }
+
+  // Two workers must never write the same file
+  return failed + removeConflicts(jobs);
+}
+} // namespace
+
+namespace Batch {
+size_t run(const Options &options) {
+  vector<Job> jobs;
+  std::atomic<size_t> failed{collect(options, &jobs)};
+  std::atomic<size_t> converted{0};
+  std::atomic<size_t> skipped{0};
+  std::atomic<size_t> next{0};
+
+  auto work = [&] {
+    // Every thread reuses its own converter
+    html2md::Options converter_options = options.converter;
+    html2md::Converter converter(&converter_options);
+
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      const Job &job = jobs[i];
+
+      std::error_code error;
+      if (!options.replace && fs::exists(job.output, error)) {
+        report(job.output, "Already exists, use -r to overwrite it");
+        ++skipped;
+        continue;
+      }
+
+      try {
+        // The converter reads the mapped file, the Markdown goes straight to
+        // the output file
+        FileUtils::MappedFile html(job.input.string());
+        converter.reset(html.data(), html.size());
+
+        if (job.output.has_parent_path())
+          fs::create_directories(job.output.parent_path());
+        FileUtils::convertToFile(&converter, job.output.string());
+
+        ++converted;
+      } catch (const std::exception &e) {
+        report(job.input, e.what());
+        ++failed;
+      }
+    }
+  };
+
+  unsigned threads = options.jobs;
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = static_cast<unsigned>(
+      std::max<size_t>(1, std::min<size_t>(threads, jobs.size())));
+
+  vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(work);
+  work();
+
+  for (auto &thread : pool)
+    thread.join();
+
+  std::cout << "Converted " << converted << " of " << jobs.size() << " files";
+  if (skipped)
+    std::cout << ", " << skipped << " skipped";
+  if (failed)
+    std::cout << ", " << failed << " failed";
+  std::cout << "." << std::endl;
+
+  // An output that wasn't written is not a success either
+  return failed + skipped;
+}
+} // namespace Batch
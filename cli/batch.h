@@ -0,0 +1,32 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_BATCH_H
+#define CLI_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "html2md.h"
+
+// Converts many files at once: `html2md -R site/ -o md/ -j 8`
+namespace Batch {
+struct Options {
+  // Files and directories
+  std::vector<std::string> inputs;
+  // Mirror the inputs in this directory, empty writes next to the inputs
+  std::string outputDir;
+  bool recursive = false;
+  bool replace = false;
+  // Number of threads, 0 uses one per hardware thread
+  unsigned jobs = 0;
+  html2md::Options converter;
+};
+
+// Converts every input file to a `.md` file. Failures are reported on stderr
+// and don't stop the run. Returns the number of files that failed or were
+// skipped because their output exists, like a single file would fail.
+size_t run(const Options &options);
+} // namespace Batch
+
+#endif // CLI_BATCH_H
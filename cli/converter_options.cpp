@@ -0,0 +1,97 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "converter_options.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using std::string;
+
+namespace {
+bool sameName(const string &name, const char *option) {
+  if (name.size() != strlen(option))
+    return false;
+
+  for (size_t i = 0; i < name.size(); ++i)
+    if (std::tolower(static_cast<unsigned char>(name[i])) !=
+        std::tolower(static_cast<unsigned char>(option[i])))
+      return false;
+
+  return true;
+}
+} // namespace
+
+namespace ConverterOptions {
+const BoolOption kBoolOptions[7] = {
+    {"splitLines", &html2md::Options::splitLines},
+    {"includeTitle", &html2md::Options::includeTitle},
+    {"formatTable", &html2md::Options::formatTable},
+    {"forceLeftTrim", &html2md::Options::forceLeftTrim},
+    {"compressWhitespace", &html2md::Options::compressWhitespace},
+    {"escapeNumberedList", &html2md::Options::escapeNumberedList},
+    {"keepHtmlEntities", &html2md::Options::keepHtmlEntities},
+};
+
+const IntOption kIntOptions[3] = {
+    {"softBreak", &html2md::Options::softBreak},
+    {"hardBreak", &html2md::Options::hardBreak},
+    {"tableSampleRows", &html2md::Options::tableSampleRows},
+};
+
+const CharOption kCharOptions[2] = {
+    {"unorderedList", &html2md::Options::unorderedList},
+    {"orderedList", &html2md::Options::orderedList},
+};
+
+bool set(const string &name, const string &value, html2md::Options *options,
+         string *error) {
+  for (const auto &option : kBoolOptions) {
+    if (!sameName(name, option.name))
+      continue;
+
+    if (value == "true" || value == "1") {
+      options->*option.member = true;
+    } else if (value == "false" || value == "0") {
+      options->*option.member = false;
+    } else {
+      *error = name + " has to be true or false";
+      return false;
+    }
+    return true;
+  }
+
+  for (const auto &option : kIntOptions) {
+    if (!sameName(name, option.name))
+      continue;
+
+    char *end = nullptr;
+    long long number = std::strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || number < -kMaxInt ||
+        number > kMaxInt) {
+      *error = name + " has to be a number";
+      return false;
+    }
+
+    options->*option.member = static_cast<int>(number);
+    return true;
+  }
+
+  for (const auto &option : kCharOptions) {
+    if (!sameName(name, option.name))
+      continue;
+
+    if (value.size() != 1) {
+      *error = name + " has to be a single character";
+      return false;
+    }
+
+    options->*option.member = value[0];
+    return true;
+  }
+
+  *error = "unknown option \"" + name + "\"";
+  return false;
+}
+} // namespace ConverterOptions
@@ -0,0 +1,43 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_CONVERTER_OPTIONS_H
+#define CLI_CONVERTER_OPTIONS_H
+
+#include <string>
+
+#include "html2md.h"
+
+// The members of html2md::Options by name, for the modes that take options
+// per request
+namespace ConverterOptions {
+struct BoolOption {
+  const char *name;
+  bool html2md::Options::*member;
+};
+
+struct IntOption {
+  const char *name;
+  int html2md::Options::*member;
+};
+
+struct CharOption {
+  const char *name;
+  char html2md::Options::*member;
+};
+
+extern const BoolOption kBoolOptions[7];
+extern const IntOption kIntOptions[3];
+extern const CharOption kCharOptions[2];
+
+// Integer options have to be in this range
+constexpr long long kMaxInt = 1000000;
+
+// Sets an option from its text: `true`/`false` (or `1`/`0`), a number or a
+// single character. The name is case-insensitive. Returns false and sets
+// `error` if the name or the value isn't valid.
+bool set(const std::string &name, const std::string &value,
+         html2md::Options *options, std::string *error);
+} // namespace ConverterOptions
+
+#endif // CLI_CONVERTER_OPTIONS_H
@@ -0,0 +1,215 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "daemon.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace {
+constexpr size_t kHeaderSize = 4;
+constexpr size_t kResponseHeaderSize = 5;
+
+enum Status : uint8_t { kOk = 0, kError = 1 };
+
+void putSize(uint32_t size, char *out) {
+  out[0] = static_cast<char>(size >> 24);
+  out[1] = static_cast<char>(size >> 16);
+  out[2] = static_cast<char>(size >> 8);
+  out[3] = static_cast<char>(size);
+}
+
+uint32_t getSize(const char *in) {
+  auto byte = [&](int i) { return static_cast<uint32_t>(uint8_t(in[i])); };
+  return byte(0) << 24 | byte(1) << 16 | byte(2) << 8 | byte(3);
+}
+
+bool sendResponse(Server::Connection *connection, Status status,
+                  const string &body) {
+  char header[kResponseHeaderSize];
+  header[0] = static_cast<char>(status);
+  putSize(static_cast<uint32_t>(body.size()), header + 1);
+
+  return connection->send(header, sizeof(header), body.data(), body.size());
+}
+
+bool makeAddress(const string &path, sockaddr_un *address, string *error) {
+  *address = {};
+  address->sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address->sun_path)) {
+    *error = "Socket path too long: " + path;
+    return false;
+  }
+
+  memcpy(address->sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+int connectTo(const string &path, string *error) {
+  sockaddr_un address;
+  if (!makeAddress(path, &address, error))
+    return -1;
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                          sizeof(address)) != 0) {
+    *error = "Can't connect to " + path + ": " + strerror(errno);
+    if (fd >= 0)
+      ::close(fd);
+    return -1;
+  }
+
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+} // namespace
+
+namespace Daemon {
+int listen(const string &path, string *error) {
+  sockaddr_un address;
+  if (!makeAddress(path, &address, error))
+    return -1;
+
+  // Replace the socket of a daemon that crashed, but not of a running one
+  struct stat info;
+  if (::lstat(path.c_str(), &info) == 0) {
+    string ignored;
+    int fd = connectTo(path, &ignored);
+    if (fd >= 0) {
+      ::close(fd);
+      *error = path + " is used by a running daemon";
+      return -1;
+    }
+
+    if (!S_ISSOCK(info.st_mode)) {
+      *error = path + " exists and isn't a socket";
+      return -1;
+    }
+    ::unlink(path.c_str());
+  }
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+          0 ||
+      ::listen(fd, SOMAXCONN) != 0) {
+    *error = "Can't listen on " + path + ": " + strerror(errno);
+    if (fd >= 0)
+      ::close(fd);
+    return -1;
+  }
+
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+bool serve(const Options &options) {
+  string error;
+  int fd = listen(options.path, &error);
+  if (fd < 0) {
+    std::cerr << error << std::endl;
+    return false;
+  }
+
+  Protocol protocol(options.maxRequestSize);
+  Server::Server server(fd, &protocol, options.jobs, options.converter);
+
+  std::cerr << "Listening on " << options.path << std::endl;
+  server.runUntilSignal();
+
+  ::unlink(options.path.c_str());
+  return true;
+}
+
+bool Protocol::ready(Server::Connection *connection) const {
+  return connection->size() >= kHeaderSize;
+}
+
+bool Protocol::handle(Server::Connection *connection,
+                      html2md::Converter *converter) {
+  if (!connection->receive(kHeaderSize))
+    return false;
+
+  size_t size = getSize(connection->data());
+  connection->consume(kHeaderSize);
+
+  if (size > max_request_size_) {
+    sendResponse(connection, kError, "Request too large");
+    return false;
+  }
+
+  // The HTML goes to the converter as it arrives, it is never copied
+  string md;
+  try {
+    // Starts a new document, also if the HTML is empty or the last request
+    // was cut off
+    converter->reset();
+    converter->feed(connection->data(), 0);
+
+    while (size != 0) {
+      if (connection->size() == 0 && !connection->receive())
+        return false;
+
+      size_t part = std::min(size, connection->size());
+      converter->feed(connection->data(), part);
+      connection->consume(part);
+      size -= part;
+    }
+
+    md = converter->finish();
+  } catch (const std::exception &e) {
+    // The rest of the request is still in the way of the next one
+    return sendResponse(connection, kError, e.what()) && size == 0;
+  }
+
+  return sendResponse(connection, kOk, md);
+}
+
+Client::Client(const string &path) {
+  string error;
+  int fd = connectTo(path, &error);
+  if (fd < 0)
+    throw std::runtime_error(error);
+
+  connection_.reset(new Server::Connection(fd));
+}
+
+string Client::convert(const char *html, size_t size) {
+  if (size > UINT32_MAX)
+    throw std::runtime_error("HTML too large");
+
+  char header[kHeaderSize];
+  putSize(static_cast<uint32_t>(size), header);
+
+  if (!connection_->send(header, sizeof(header), html, size) ||
+      !connection_->receive(kResponseHeaderSize))
+    throw std::runtime_error("Connection to the daemon failed");
+
+  auto status = static_cast<uint8_t>(connection_->data()[0]);
+  size_t body_size = getSize(connection_->data() + 1);
+  connection_->consume(kResponseHeaderSize);
+
+  if (!connection_->receive(body_size))
+    throw std::runtime_error("Connection to the daemon failed");
+
+  string body(connection_->data(), body_size);
+  connection_->consume(body_size);
+
+  if (status != kOk)
+    throw std::runtime_error(body);
+
+  return body;
+}
+} // namespace Daemon
@@ -0,0 +1,72 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_DAEMON_H
+#define CLI_DAEMON_H
+
+#include <cstddef>
+#include <string>
+
+#include "html2md.h"
+#include "server.h"
+
+// `html2md --serve /run/html2md.sock`: converts HTML sent over a Unix domain
+// socket. A client can send any number of requests over one connection, each
+// one framed with its length:
+//
+//   request:  uint32 size, then `size` bytes of HTML
+//   response: uint8 status, uint32 size, then `size` bytes of Markdown
+//             (status 0) or of an error message (status 1)
+//
+// All integers are big-endian. The responses come in the order of the
+// requests. Every request is converted with the options given on the command
+// line.
+namespace Daemon {
+struct Options {
+  std::string path;
+  // Number of worker threads, 0 uses one per hardware thread
+  unsigned jobs = 0;
+  // Larger requests get an error response and the connection is closed
+  size_t maxRequestSize = 256 * 1024 * 1024;
+  html2md::Options converter;
+};
+
+// Creates the socket and listens on it. A socket left behind by a daemon
+// that isn't running anymore is replaced. Returns -1 and sets `error` if that
+// fails.
+int listen(const std::string &path, std::string *error);
+
+// Serves until SIGINT or SIGTERM, then removes the socket. Returns false if
+// the socket couldn't be created.
+bool serve(const Options &options);
+
+class Protocol : public Server::Handler {
+public:
+  explicit Protocol(size_t max_request_size)
+      : max_request_size_(max_request_size) {}
+
+  // The size of the request is buffered
+  bool ready(Server::Connection *connection) const override;
+
+  bool handle(Server::Connection *connection,
+              html2md::Converter *converter) override;
+
+private:
+  size_t max_request_size_;
+};
+
+// A connection to a daemon. All functions throw std::runtime_error if the
+// connection fails.
+class Client {
+public:
+  explicit Client(const std::string &path);
+
+  // Throws the error message if the daemon couldn't convert the HTML
+  std::string convert(const char *html, size_t size);
+
+private:
+  std::unique_ptr<Server::Connection> connection_;
+};
+} // namespace Daemon
+
+#endif // CLI_DAEMON_H
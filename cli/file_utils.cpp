@@ -0,0 +1,261 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "file_utils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "sink.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+
+namespace {
+// Read from pipes at a time
+constexpr size_t kChunkSize = 64 * 1024;
+
+[[noreturn]] void fail(const string &what, const string &file) {
+  throw std::runtime_error(what + " " + file + ": " + strerror(errno));
+}
+
+#ifdef _WIN32
+int openFile(const string &file, int flags, int mode = 0) {
+  return ::_open(file.c_str(), flags | _O_BINARY, mode);
+}
+int closeFile(int fd) { return ::_close(fd); }
+int readFile(int fd, char *buffer, size_t size) {
+  return ::_read(fd, buffer, static_cast<unsigned>(size));
+}
+#else
+int openFile(const string &file, int flags, int mode = 0) {
+  return ::open(file.c_str(), flags | O_CLOEXEC, mode);
+}
+int closeFile(int fd) { return ::close(fd); }
+ssize_t readFile(int fd, char *buffer, size_t size) {
+  return ::read(fd, buffer, size);
+}
+#endif
+} // namespace
+
+namespace FileUtils {
+bool exists(const std::string &name) {
+  struct stat info;
+  return ::stat(name.c_str(), &info) == 0;
+}
+
+bool sameFile(const string &a, const string &b) {
+#ifdef _WIN32
+  return a == b;
+#else
+  struct stat info_a, info_b;
+  return ::stat(a.c_str(), &info_a) == 0 && ::stat(b.c_str(), &info_b) == 0 &&
+         info_a.st_dev == info_b.st_dev && info_a.st_ino == info_b.st_ino;
+#endif
+}
+
+MappedFile::MappedFile(const string &file) {
+  int fd = openFile(file, O_RDONLY);
+  if (fd < 0)
+    fail("Error reading file", file);
+
+#ifndef _WIN32
+  struct stat info;
+  if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void *data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // The converter reads the HTML front to back
+      ::madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+      data_ = static_cast<const char *>(data);
+      size_ = static_cast<size_t>(info.st_size);
+      mapped_ = true;
+      closeFile(fd);
+      return;
+    }
+  }
+#endif
+
+  try {
+    ReadAll(fd, file);
+  } catch (...) {
+    closeFile(fd);
+    throw;
+  }
+  closeFile(fd);
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (mapped_)
+    ::munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+void MappedFile::ReadAll(int fd, const string &file) {
+  size_t size = 0;
+  buffer_.resize(kChunkSize);
+
+  for (;;) {
+    if (size == buffer_.size())
+      buffer_.resize(buffer_.size() * 2);
+
+    auto n = readFile(fd, &buffer_[size], buffer_.size() - size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fail("Error reading file", file);
+    }
+    if (n == 0)
+      break;
+
+    size += static_cast<size_t>(n);
+  }
+
+  buffer_.resize(size);
+  data_ = buffer_.data();
+  size_ = size;
+}
+
+bool LineReader::next(string *line) {
+  too_long_ = false;
+
+  for (;;) {
+    const char *start = buffer_.data() + begin_;
+    size_t available = buffer_.size() - begin_;
+
+    const char *end = static_cast<const char *>(
+        memchr(start + scanned_, '\n', available - scanned_));
+    if (end || (eof_ && (available != 0 || skipping_))) {
+      size_t size = end ? static_cast<size_t>(end - start) : available;
+      begin_ += end ? size + 1 : size;
+      scanned_ = 0;
+
+      if (size != 0 && start[size - 1] == '\r')
+        --size;
+
+      too_long_ = skipping_ || size > max_size_;
+      skipping_ = false;
+      if (too_long_)
+        line->clear();
+      else
+        line->assign(start, size);
+      return true;
+    }
+
+    if (eof_)
+      return false;
+
+    // Drop what was read of a line that is too long
+    if (available > max_size_) {
+      skipping_ = true;
+      begin_ = buffer_.size();
+      available = 0;
+    }
+    scanned_ = available;
+
+    // Move the unfinished line to the front and read more
+    buffer_.erase(0, begin_);
+    begin_ = 0;
+    size_t size = buffer_.size();
+    buffer_.resize(size + kChunkSize);
+
+    auto n = readFile(fd_, &buffer_[size], kChunkSize);
+    if (n < 0 && errno != EINTR)
+      fail("Error reading", "input");
+
+    buffer_.resize(size + (n > 0 ? static_cast<size_t>(n) : 0));
+    eof_ = n == 0;
+  }
+}
+
+OutputFile::OutputFile(const string &file) : name_(file) {
+  fd_ = openFile(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+    fail("Error writing file", file);
+}
+
+OutputFile::~OutputFile() {
+  if (fd_ >= 0)
+    closeFile(fd_);
+}
+
+void OutputFile::close() {
+  int fd = fd_;
+  fd_ = -1;
+  if (fd >= 0 && closeFile(fd) != 0)
+    fail("Error writing file", name_);
+}
+
+void writeFile(const string &file, const string &content) {
+  OutputFile out(file);
+
+  html2md::FdSink sink(out.fd());
+  sink.write(content.data(), content.size());
+  if (!sink.ok())
+    fail("Error writing file", file);
+
+  out.close();
+}
+
+void convertToFile(html2md::Converter *converter, const string &file) {
+  OutputFile out(file);
+
+  html2md::FdSink sink(out.fd());
+  converter->setSink(&sink);
+  try {
+    (void)converter->convert();
+  } catch (...) {
+    converter->setSink(nullptr);
+    throw;
+  }
+  converter->setSink(nullptr);
+
+  if (!sink.ok())
+    fail("Error writing file", file);
+
+  out.close();
+}
+
+void convertStream(html2md::Converter *converter, int in, int out) {
+  html2md::FdSink sink(out);
+  converter->setSink(&sink);
+
+  try {
+    string chunk(kChunkSize, '\0');
+    for (;;) {
+      auto n = readFile(in, &chunk[0], chunk.size());
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        fail("Error reading", "input");
+      }
+      if (n == 0)
+        break;
+
+      converter->feed(chunk.data(), static_cast<size_t>(n));
+      if (!sink.ok())
+        fail("Error writing", "output");
+    }
+
+    (void)converter->finish();
+  } catch (...) {
+    converter->setSink(nullptr);
+    throw;
+  }
+  converter->setSink(nullptr);
+
+  if (!sink.ok())
+    fail("Error writing", "output");
+}
+} // namespace FileUtils
@@ -0,0 +1,100 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_FILE_UTILS_H
+#define CLI_FILE_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "html2md.h"
+
+// All functions throw std::runtime_error if a file can't be read or written
+namespace FileUtils {
+bool exists(const std::string &name);
+
+// Whether both names refer to the same file
+bool sameFile(const std::string &a, const std::string &b);
+
+// Maps a file into memory, so it can be converted without copying it. Pipes
+// and other files that can't be mapped are read into a buffer instead.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &file);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  void ReadAll(int fd, const std::string &file);
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;
+};
+
+// Reads a file descriptor line by line, without the line breaks. A line longer
+// than `max_size` isn't kept in memory: it is skipped, and next() returns it
+// empty with tooLong() set.
+class LineReader {
+public:
+  explicit LineReader(int fd, size_t max_size = SIZE_MAX)
+      : fd_(fd), max_size_(max_size) {}
+
+  // Returns false at the end of the input
+  bool next(std::string *line);
+
+  // Whether the last line was skipped for its size
+  bool tooLong() const { return too_long_; }
+
+private:
+  int fd_;
+  size_t max_size_;
+  std::string buffer_;
+  size_t begin_ = 0;
+  // Bytes after begin_ known to contain no line break
+  size_t scanned_ = 0;
+  // The current line is too long, only its end is looked for
+  bool skipping_ = false;
+  bool too_long_ = false;
+  bool eof_ = false;
+};
+
+// A file opened for writing, closed by the destructor
+class OutputFile {
+public:
+  explicit OutputFile(const std::string &file);
+  ~OutputFile();
+
+  OutputFile(const OutputFile &) = delete;
+  OutputFile &operator=(const OutputFile &) = delete;
+
+  int fd() const { return fd_; }
+
+  // Reports errors the destructor would ignore
+  void close();
+
+private:
+  int fd_;
+  std::string name_;
+};
+
+void writeFile(const std::string &file, const std::string &content);
+
+// Runs the conversion and writes the Markdown to the file while it's
+// generated, it is never held in memory as a whole
+void convertToFile(html2md::Converter *converter, const std::string &file);
+
+// Converts the HTML read from `in` in chunks and writes the Markdown to `out`
+// as soon as it is finished. Only the unfinished part of the Markdown (e.g. an
+// open table) is kept in memory.
+void convertStream(html2md::Converter *converter, int in, int out);
+} // namespace FileUtils
+
+#endif // CLI_FILE_UTILS_H
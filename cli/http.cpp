@@ -0,0 +1,533 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "http.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "converter_options.h"
+
+using std::string;
+
+namespace {
+// Request line and headers
+constexpr size_t kMaxHeadSize = 64 * 1024;
+// Chunk size lines and trailers
+constexpr size_t kMaxLineSize = 4 * 1024;
+
+constexpr char kOptionHeader[] = "html2md-";
+
+struct Request {
+  string method;
+  string path;
+  string query;
+  bool http10 = false;
+  bool keep_alive = true;
+  bool chunked = false;
+  bool expect_continue = false;
+  // Not set if the request has no Content-Length
+  bool has_length = false;
+  size_t length = 0;
+  // Options from the query and the headers
+  std::vector<std::pair<string, string>> options;
+};
+
+// An error response, the connection is closed after it
+struct Error {
+  int status;
+  const char *reason;
+  string message;
+};
+
+string toLower(string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+string trim(const string &text) {
+  size_t begin = text.find_first_not_of(" \t");
+  if (begin == string::npos)
+    return "";
+
+  size_t end = text.find_last_not_of(" \t");
+  return text.substr(begin, end - begin + 1);
+}
+
+int hexValue(char ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+// Decodes %XX and + of a query
+string percentDecode(const string &text) {
+  string decoded;
+  decoded.reserve(text.size());
+
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '+') {
+      decoded += ' ';
+    } else if (text[i] == '%' && i + 2 < text.size() &&
+               hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+      decoded += static_cast<char>(hexValue(text[i + 1]) << 4 |
+                                   hexValue(text[i + 2]));
+      i += 2;
+    } else {
+      decoded += text[i];
+    }
+  }
+
+  return decoded;
+}
+
+void parseQuery(const string &query, Request *request) {
+  size_t begin = 0;
+  while (begin < query.size()) {
+    size_t end = query.find('&', begin);
+    if (end == string::npos)
+      end = query.size();
+
+    string pair = query.substr(begin, end - begin);
+    size_t equals = pair.find('=');
+    if (!pair.empty())
+      request->options.emplace_back(
+          percentDecode(pair.substr(0, equals)),
+          equals == string::npos ? "" : percentDecode(pair.substr(equals + 1)));
+
+    begin = end + 1;
+  }
+}
+
+// Parses the request line and the headers, `head` ends with the blank line
+bool parseHead(const string &head, Request *request, Error *error) {
+  size_t line_end = head.find("\r\n");
+  string line = head.substr(0, line_end);
+
+  // METHOD target HTTP/1.x
+  size_t space = line.find(' ');
+  size_t second_space = line.find(' ', space + 1);
+  if (space == string::npos || second_space == string::npos) {
+    *error = {400, "Bad Request", "Malformed request line"};
+    return false;
+  }
+
+  request->method = line.substr(0, space);
+  string target = line.substr(space + 1, second_space - space - 1);
+  string version = line.substr(second_space + 1);
+
+  if (version == "HTTP/1.0") {
+    request->http10 = true;
+    request->keep_alive = false;
+  } else if (version != "HTTP/1.1") {
+    *error = {505, "HTTP Version Not Supported", "Only HTTP/1.x is supported"};
+    return false;
+  }
+
+  size_t question = target.find('?');
+  request->path = target.substr(0, question);
+  if (question != string::npos)
+    request->query = target.substr(question + 1);
+
+  for (size_t begin = line_end + 2; begin < head.size();) {
+    size_t end = head.find("\r\n", begin);
+    if (end == string::npos || end == begin)
+      break;
+
+    string header = head.substr(begin, end - begin);
+    begin = end + 2;
+
+    size_t colon = header.find(':');
+    if (colon == string::npos) {
+      *error = {400, "Bad Request", "Malformed header"};
+      return false;
+    }
+
+    string name = toLower(trim(header.substr(0, colon)));
+    string value = trim(header.substr(colon + 1));
+    string lower_value = toLower(value);
+
+    if (name == "content-length") {
+      // Digits only, a proxy might read anything else differently
+      size_t length = 0;
+      bool valid = !value.empty();
+      for (char ch : value) {
+        if (ch < '0' || ch > '9' || length > SIZE_MAX / 10 - 1) {
+          valid = false;
+          break;
+        }
+        length = length * 10 + static_cast<size_t>(ch - '0');
+      }
+
+      if (!valid || (request->has_length && request->length != length)) {
+        *error = {400, "Bad Request", "Invalid Content-Length"};
+        return false;
+      }
+
+      request->has_length = true;
+      request->length = length;
+    } else if (name == "transfer-encoding") {
+      if (lower_value != "chunked") {
+        *error = {501, "Not Implemented", "Unsupported Transfer-Encoding"};
+        return false;
+      }
+      request->chunked = true;
+    } else if (name == "connection") {
+      if (lower_value.find("close") != string::npos)
+        request->keep_alive = false;
+      else if (lower_value.find("keep-alive") != string::npos)
+        request->keep_alive = true;
+    } else if (name == "expect") {
+      request->expect_continue = lower_value == "100-continue";
+    } else if (name.compare(0, sizeof(kOptionHeader) - 1, kOptionHeader) ==
+               0) {
+      request->options.emplace_back(name.substr(sizeof(kOptionHeader) - 1),
+                                    value);
+    }
+  }
+
+  // Either framing could be the one a proxy in front used
+  if (request->chunked && request->has_length) {
+    *error = {400, "Bad Request", "Both Content-Length and chunked"};
+    return false;
+  }
+
+  parseQuery(request->query, request);
+  return true;
+}
+
+// Line breaks between pipelined requests are allowed
+size_t skipBlankLines(const char *data, size_t size) {
+  size_t skipped = 0;
+  while (skipped < size && (data[skipped] == '\r' || data[skipped] == '\n'))
+    ++skipped;
+  return skipped;
+}
+
+// Size of the request head at the start of `data` with the blank line ending
+// it, 0 if it isn't complete. `from` is where the search can start.
+size_t findHead(const char *data, size_t size, size_t from) {
+  const char *end =
+      std::search(data + from, data + size, "\r\n\r\n", "\r\n\r\n" + 4);
+  return end != data + size ? static_cast<size_t>(end - data) + 4 : 0;
+}
+
+// Reads a line, without its line break
+bool receiveLine(Server::Connection *connection, string *line) {
+  size_t scanned = 0;
+
+  for (;;) {
+    const char *data = connection->data();
+    const void *end =
+        memchr(data + scanned, '\n', connection->size() - scanned);
+
+    if (end) {
+      size_t size = static_cast<size_t>(static_cast<const char *>(end) - data);
+      line->assign(data, size);
+      if (!line->empty() && line->back() == '\r')
+        line->pop_back();
+
+      connection->consume(size + 1);
+      return true;
+    }
+
+    scanned = connection->size();
+    if (scanned > kMaxLineSize || !connection->receive())
+      return false;
+  }
+}
+
+// Passes the next `size` bytes of the body to the converter
+bool feedBody(Server::Connection *connection, html2md::Converter *converter,
+              size_t size) {
+  while (size != 0) {
+    if (connection->size() == 0 && !connection->receive())
+      return false;
+
+    size_t part = std::min(size, connection->size());
+    converter->feed(connection->data(), part);
+    connection->consume(part);
+    size -= part;
+  }
+
+  return true;
+}
+
+bool feedChunkedBody(Server::Connection *connection,
+                     html2md::Converter *converter, size_t max_size,
+                     Error *error) {
+  size_t total = 0;
+  string line;
+
+  for (;;) {
+    // Size in hex, maybe followed by extensions after a `;`
+    if (!receiveLine(connection, &line)) {
+      *error = {400, "Bad Request", "Malformed chunk"};
+      return false;
+    }
+
+    size_t size = 0;
+    size_t digits = 0;
+    for (; digits < line.size() && hexValue(line[digits]) >= 0; ++digits) {
+      if (size > max_size) {
+        *error = {413, "Payload Too Large", "Request too large"};
+        return false;
+      }
+      size = size << 4 | static_cast<size_t>(hexValue(line[digits]));
+    }
+
+    // Only whitespace or extensions may follow the size
+    size_t rest = digits;
+    while (rest < line.size() && (line[rest] == ' ' || line[rest] == '\t'))
+      ++rest;
+
+    if (digits == 0 || (rest != line.size() && line[rest] != ';')) {
+      *error = {400, "Bad Request", "Malformed chunk size"};
+      return false;
+    }
+
+    if (size == 0)
+      break;
+
+    total += size;
+    if (total > max_size) {
+      *error = {413, "Payload Too Large", "Request too large"};
+      return false;
+    }
+
+    // The chunk and its line break
+    if (!feedBody(connection, converter, size) ||
+        !receiveLine(connection, &line) || !line.empty()) {
+      *error = {400, "Bad Request", "Malformed chunk"};
+      return false;
+    }
+  }
+
+  // Trailers end with a blank line
+  do {
+    if (!receiveLine(connection, &line)) {
+      *error = {400, "Bad Request", "Malformed trailer"};
+      return false;
+    }
+  } while (!line.empty());
+
+  return true;
+}
+
+bool sendResponse(Server::Connection *connection, const Request &request,
+                  int status, const char *reason, const char *type,
+                  const string &body, const char *headers = "") {
+  string head = "HTTP/1.1 " + std::to_string(status) + " " + reason +
+                "\r\nContent-Type: " + type +
+                "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" +
+                headers;
+
+  if (!request.keep_alive)
+    head += "Connection: close\r\n";
+  else if (request.http10)
+    head += "Connection: keep-alive\r\n";
+  head += "\r\n";
+
+  return connection->send(head.data(), head.size(), body.data(),
+                          body.size()) &&
+         request.keep_alive;
+}
+
+bool sendError(Server::Connection *connection, Request request,
+               const Error &error, const char *headers = "") {
+  request.keep_alive = false;
+  sendResponse(connection, request, error.status, error.reason,
+               "text/plain; charset=utf-8", error.message + "\n", headers);
+  return false;
+}
+} // namespace
+
+namespace Http {
+int listen(const string &address, string *error) {
+  string host;
+  string port = address;
+
+  size_t colon = address.rfind(':');
+  if (colon != string::npos) {
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+  }
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+    host = host.substr(1, host.size() - 2);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  addrinfo *addresses = nullptr;
+  int result = ::getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                             port.c_str(), &hints, &addresses);
+  if (result != 0) {
+    *error = "Invalid address " + address + ": " + gai_strerror(result);
+    return -1;
+  }
+
+  int fd = -1;
+  int last_errno = 0;
+  for (addrinfo *a = addresses; a; a = a->ai_next) {
+    fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) {
+      last_errno = errno;
+      continue;
+    }
+
+    // Restarting doesn't have to wait for old connections to time out
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (::bind(fd, a->ai_addr, a->ai_addrlen) == 0 &&
+        ::listen(fd, SOMAXCONN) == 0)
+      break;
+
+    last_errno = errno;
+    ::close(fd);
+    fd = -1;
+  }
+  ::freeaddrinfo(addresses);
+
+  if (fd < 0) {
+    *error = "Can't listen on " + address + ": " + strerror(last_errno);
+    return -1;
+  }
+
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+bool serve(const Options &options) {
+  string error;
+  int fd = listen(options.address, &error);
+  if (fd < 0) {
+    std::cerr << error << std::endl;
+    return false;
+  }
+
+  Protocol protocol(options.converter, options.maxRequestSize);
+  Server::Server server(fd, &protocol, options.jobs, options.converter);
+
+  std::cerr << "Listening on http://" << options.address << "/convert"
+            << std::endl;
+  server.runUntilSignal();
+  return true;
+}
+
+bool Protocol::ready(Server::Connection *connection) const {
+  const char *data = connection->data();
+  size_t size = connection->size();
+
+  // Only the new data is searched, the end of the head can start up to three
+  // bytes before it
+  size_t from = skipBlankLines(data, size);
+  if (connection->checked() > from + 3)
+    from = connection->checked() - 3;
+  connection->setChecked(size);
+
+  return findHead(data, size, from) != 0 || size > kMaxHeadSize;
+}
+
+bool Protocol::handle(Server::Connection *connection,
+                      html2md::Converter *converter) {
+  Request request;
+
+  // ready() made sure the head is buffered, unless it is too large
+  connection->consume(skipBlankLines(connection->data(), connection->size()));
+  size_t head_size = findHead(connection->data(), connection->size(), 0);
+  if (head_size == 0 || head_size > kMaxHeadSize)
+    return sendError(
+        connection, request,
+        {431, "Request Header Fields Too Large", "Header too large"});
+
+  string head(connection->data(), head_size);
+  connection->consume(head_size);
+
+  Error error;
+  if (!parseHead(head, &request, &error))
+    return sendError(connection, request, error);
+
+  if (request.path != "/convert")
+    return sendError(connection, request, {404, "Not Found", "Not found"});
+
+  if (request.method != "POST")
+    return sendError(connection, request,
+                     {405, "Method Not Allowed", "Use POST"},
+                     "Allow: POST\r\n");
+
+  if (request.has_length && request.length > max_request_size_)
+    return sendError(connection, request,
+                     {413, "Payload Too Large", "Request too large"});
+
+  html2md::Options options = defaults_;
+  for (const auto &option : request.options) {
+    string message;
+    if (!ConverterOptions::set(option.first, option.second, &options,
+                               &message))
+      return sendError(connection, request,
+                       {400, "Bad Request", std::move(message)});
+  }
+
+  // Requests with other options get a second converter per thread
+  if (!(options == defaults_)) {
+    thread_local std::unique_ptr<html2md::Converter> custom;
+    thread_local html2md::Options custom_options;
+
+    if (!custom || !(custom_options == options)) {
+      custom_options = options;
+      custom.reset(new html2md::Converter(&custom_options));
+    }
+    converter = custom.get();
+  }
+
+  if (request.expect_continue && !request.http10) {
+    static const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (!connection->send(kContinue, sizeof(kContinue) - 1))
+      return false;
+  }
+
+  // The body goes to the converter as it arrives, it is never copied
+  string md;
+  try {
+    // Starts a new document, also if the body is empty or the last request
+    // was cut off
+    converter->reset();
+    converter->feed(connection->data(), 0);
+
+    if (request.chunked) {
+      if (!feedChunkedBody(connection, converter, max_request_size_, &error))
+        return sendError(connection, request, error);
+    } else if (request.has_length &&
+               !feedBody(connection, converter, request.length)) {
+      return false;
+    }
+
+    md = converter->finish();
+  } catch (const std::exception &e) {
+    return sendError(connection, request,
+                     {500, "Internal Server Error", e.what()});
+  }
+
+  return sendResponse(connection, request, 200, "OK",
+                      "text/markdown; charset=utf-8", md);
+}
+} // namespace Http
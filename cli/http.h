@@ -0,0 +1,60 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_HTTP_H
+#define CLI_HTTP_H
+
+#include <cstddef>
+#include <string>
+
+#include "html2md.h"
+#include "server.h"
+
+// `html2md --http 127.0.0.1:8080`: converts the HTML posted to /convert
+//
+//   curl --data-binary @page.html 'localhost:8080/convert?splitLines=false'
+//
+// Options are taken from the query and from headers named `Html2md-<option>`
+// (e.g. `Html2md-SoftBreak: 120`), with the names of the members of
+// html2md::Options, and override the options given on the command line.
+// Bodies can be sent with Content-Length or chunked, they are converted while
+// they arrive. Connections are kept alive and pipelined requests are answered
+// in order. After an error response the connection is closed.
+namespace Http {
+struct Options {
+  // host:port, [ipv6]:port or :port for all interfaces
+  std::string address;
+  // Number of worker threads, 0 uses one per hardware thread
+  unsigned jobs = 0;
+  // Larger bodies get a 413 response
+  size_t maxRequestSize = 256 * 1024 * 1024;
+  html2md::Options converter;
+};
+
+// Creates a TCP socket listening on `address`. Returns -1 and sets `error` if
+// that fails.
+int listen(const std::string &address, std::string *error);
+
+// Serves until SIGINT or SIGTERM. Returns false if the socket couldn't be
+// created.
+bool serve(const Options &options);
+
+class Protocol : public Server::Handler {
+public:
+  // `defaults` have to be the options of the converters of the server
+  Protocol(const html2md::Options &defaults, size_t max_request_size)
+      : defaults_(defaults), max_request_size_(max_request_size) {}
+
+  // The request line and the headers are buffered
+  bool ready(Server::Connection *connection) const override;
+
+  bool handle(Server::Connection *connection,
+              html2md::Converter *converter) override;
+
+private:
+  html2md::Options defaults_;
+  size_t max_request_size_;
+};
+} // namespace Http
+
+#endif // CLI_HTTP_H
@@ -0,0 +1,421 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "json.h"
+
+#include <cstring>
+
+using std::string;
+
+namespace {
+// Deepest nesting of arrays and objects skipValue() accepts
+constexpr size_t kMaxDepth = 256;
+
+bool isDigit(const char *p, const char *end) {
+  return p != end && *p >= '0' && *p <= '9';
+}
+
+bool needsEscape(unsigned char ch) {
+  return ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+int hexValue(char ch) {
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'f')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F')
+    return ch - 'A' + 10;
+  return -1;
+}
+
+void appendUtf8(unsigned long code_point, string *out) {
+  if (code_point < 0x80) {
+    *out += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    *out += static_cast<char>(0xC0 | (code_point >> 6));
+    *out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    *out += static_cast<char>(0xE0 | (code_point >> 12));
+    *out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    *out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    *out += static_cast<char>(0xF0 | (code_point >> 18));
+    *out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    *out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    *out += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+} // namespace
+
+namespace Json {
+void appendString(const char *value, size_t size, string *out) {
+  static const char kHex[] = "0123456789abcdef";
+
+  out->reserve(out->size() + size + 2);
+  *out += '"';
+
+  size_t run = 0;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char ch = static_cast<unsigned char>(value[i]);
+    if (!needsEscape(ch))
+      continue;
+
+    // Copy the text in front of the character in one go
+    out->append(value + run, i - run);
+    run = i + 1;
+
+    switch (ch) {
+    case '"':
+      *out += "\\\"";
+      break;
+    case '\\':
+      *out += "\\\\";
+      break;
+    case '\n':
+      *out += "\\n";
+      break;
+    case '\r':
+      *out += "\\r";
+      break;
+    case '\t':
+      *out += "\\t";
+      break;
+    default:
+      *out += "\\u00";
+      *out += kHex[ch >> 4];
+      *out += kHex[ch & 0xF];
+    }
+  }
+
+  out->append(value + run, size - run);
+  *out += '"';
+}
+
+bool Reader::beginObject() {
+  if (!Expect('{'))
+    return false;
+
+  after_open_ = true;
+  return true;
+}
+
+bool Reader::nextKey(string *key, bool *more) {
+  SkipWhitespace();
+  if (!error_.empty())
+    return false;
+
+  if (p_ != end_ && *p_ == '}') {
+    ++p_;
+    after_open_ = false;
+    *more = false;
+    return true;
+  }
+
+  if (!after_open_ && !Expect(','))
+    return false;
+  after_open_ = false;
+
+  *more = true;
+  return readString(key) && Expect(':');
+}
+
+bool Reader::readString(string *value) {
+  if (!Expect('"'))
+    return false;
+
+  value->clear();
+  for (;;) {
+    // Copy everything up to the next quote or escape sequence
+    const char *start = p_;
+    while (p_ != end_ && *p_ != '"' && *p_ != '\\')
+      ++p_;
+    value->append(start, static_cast<size_t>(p_ - start));
+
+    if (p_ == end_)
+      return fail("unterminated string");
+
+    if (*p_++ == '"')
+      return true;
+
+    if (p_ == end_)
+      return fail("unterminated string");
+
+    char ch = *p_++;
+    switch (ch) {
+    case '"':
+    case '\\':
+    case '/':
+      *value += ch;
+      break;
+    case 'b':
+      *value += '\b';
+      break;
+    case 'f':
+      *value += '\f';
+      break;
+    case 'n':
+      *value += '\n';
+      break;
+    case 'r':
+      *value += '\r';
+      break;
+    case 't':
+      *value += '\t';
+      break;
+    case 'u': {
+      unsigned long code_point = 0;
+      for (int units = 0;; ++units) {
+        if (end_ - p_ < 4)
+          return fail("invalid \\u escape");
+
+        unsigned long unit = 0;
+        for (int i = 0; i < 4; ++i) {
+          int digit = hexValue(*p_++);
+          if (digit < 0)
+            return fail("invalid \\u escape");
+          unit = unit << 4 | static_cast<unsigned long>(digit);
+        }
+
+        if (units == 0) {
+          code_point = unit;
+          // A high surrogate is followed by `\u` and the low one
+          if (unit < 0xD800 || unit > 0xDBFF || end_ - p_ < 6 ||
+              p_[0] != '\\' || p_[1] != 'u')
+            break;
+          p_ += 2;
+        } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+          code_point =
+              0x10000 + ((code_point - 0xD800) << 10) + (unit - 0xDC00);
+          break;
+        } else {
+          // Not a low surrogate, keep both as they are
+          appendUtf8(code_point, value);
+          code_point = unit;
+          break;
+        }
+      }
+      appendUtf8(code_point, value);
+      break;
+    }
+    default:
+      return fail(string("invalid escape sequence \\") + ch);
+    }
+  }
+}
+
+bool Reader::readBool(bool *value) {
+  SkipWhitespace();
+  if (!error_.empty())
+    return false;
+
+  if (end_ - p_ >= 4 && memcmp(p_, "true", 4) == 0) {
+    p_ += 4;
+    *value = true;
+    return true;
+  }
+  if (end_ - p_ >= 5 && memcmp(p_, "false", 5) == 0) {
+    p_ += 5;
+    *value = false;
+    return true;
+  }
+
+  return fail("expected true or false");
+}
+
+bool Reader::readInt(long long *value) {
+  SkipWhitespace();
+  if (!error_.empty())
+    return false;
+
+  bool negative = p_ != end_ && *p_ == '-';
+  if (negative)
+    ++p_;
+
+  if (p_ == end_ || *p_ < '0' || *p_ > '9')
+    return fail("expected an integer");
+
+  long long result = 0;
+  while (p_ != end_ && *p_ >= '0' && *p_ <= '9') {
+    if (result > 1000000000000LL)
+      return fail("integer too large");
+    result = result * 10 + (*p_++ - '0');
+  }
+
+  if (p_ != end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E'))
+    return fail("expected an integer");
+
+  *value = negative ? -result : result;
+  return true;
+}
+
+bool Reader::skipValue(const char **begin, const char **end) {
+  SkipWhitespace();
+  if (!error_.empty())
+    return false;
+
+  const char *start = p_;
+  if (!SkipValue(0))
+    return false;
+
+  if (begin)
+    *begin = start;
+  if (end)
+    *end = p_;
+  return true;
+}
+
+bool Reader::atEnd() {
+  SkipWhitespace();
+  return error_.empty() && p_ == end_;
+}
+
+bool Reader::fail(const string &message) {
+  if (error_.empty())
+    error_ = message;
+  p_ = end_;
+  return false;
+}
+
+void Reader::SkipWhitespace() {
+  while (p_ != end_ &&
+         (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n'))
+    ++p_;
+}
+
+bool Reader::Expect(char ch) {
+  SkipWhitespace();
+  if (!error_.empty())
+    return false;
+
+  if (p_ == end_ || *p_ != ch)
+    return fail(string("expected '") + ch + "'");
+
+  ++p_;
+  return true;
+}
+
+bool Reader::SkipValue(size_t depth) {
+  SkipWhitespace();
+  if (p_ == end_)
+    return fail("expected a value");
+
+  switch (*p_) {
+  case '"':
+    return SkipString();
+  case '{':
+  case '[':
+    return SkipContainer(depth);
+  case 't':
+    return SkipLiteral("true");
+  case 'f':
+    return SkipLiteral("false");
+  case 'n':
+    return SkipLiteral("null");
+  default:
+    return SkipNumber();
+  }
+}
+
+bool Reader::SkipContainer(size_t depth) {
+  if (depth == kMaxDepth)
+    return fail("nesting too deep");
+
+  // p_ is at the opening bracket
+  char close = *p_++ == '{' ? '}' : ']';
+
+  SkipWhitespace();
+  if (p_ != end_ && *p_ == close) {
+    ++p_;
+    return true;
+  }
+
+  for (;;) {
+    if (close == '}') {
+      SkipWhitespace();
+      if (p_ == end_ || *p_ != '"')
+        return fail("expected a key");
+      if (!SkipString() || !Expect(':'))
+        return false;
+    }
+
+    if (!SkipValue(depth + 1))
+      return false;
+
+    SkipWhitespace();
+    if (p_ == end_ || *p_ != ',')
+      return Expect(close);
+    ++p_;
+  }
+}
+
+bool Reader::SkipNumber() {
+  if (p_ != end_ && *p_ == '-')
+    ++p_;
+
+  if (!isDigit(p_, end_))
+    return fail("expected a value");
+
+  // No leading zeros
+  if (*p_ == '0')
+    ++p_;
+  else
+    while (isDigit(p_, end_))
+      ++p_;
+
+  if (p_ != end_ && *p_ == '.') {
+    if (!isDigit(++p_, end_))
+      return fail("invalid number");
+    while (isDigit(p_, end_))
+      ++p_;
+  }
+
+  if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+    if (++p_ != end_ && (*p_ == '+' || *p_ == '-'))
+      ++p_;
+    if (!isDigit(p_, end_))
+      return fail("invalid number");
+    while (isDigit(p_, end_))
+      ++p_;
+  }
+
+  return true;
+}
+
+bool Reader::SkipLiteral(const char *literal) {
+  size_t size = strlen(literal);
+  if (static_cast<size_t>(end_ - p_) < size || memcmp(p_, literal, size) != 0)
+    return fail("expected a value");
+
+  p_ += size;
+  return true;
+}
+
+bool Reader::SkipString() {
+  // p_ is at the opening quote
+  for (++p_; p_ != end_; ++p_) {
+    auto ch = static_cast<unsigned char>(*p_);
+    if (ch == '"') {
+      ++p_;
+      return true;
+    }
+    if (ch < 0x20)
+      return fail("control character in string");
+    if (ch != '\\')
+      continue;
+
+    if (++p_ == end_)
+      break;
+
+    if (*p_ == 'u') {
+      for (int i = 0; i < 4; ++i)
+        if (++p_ == end_ || hexValue(*p_) < 0)
+          return fail("invalid \\u escape");
+    } else if (*p_ == '\0' || !strchr("\"\\/bfnrt", *p_)) {
+      return fail(string("invalid escape sequence \\") + *p_);
+    }
+  }
+
+  return fail("unterminated string");
+}
+} // namespace Json
@@ -0,0 +1,61 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_JSON_H
+#define CLI_JSON_H
+
+#include <cstddef>
+#include <string>
+
+// Just enough JSON for the NDJSON mode: reading the keys of an object and
+// their values, and writing strings.
+namespace Json {
+// Appends `value` as a quoted JSON string. Bytes that aren't ASCII are copied
+// unchanged.
+void appendString(const char *value, size_t size, std::string *out);
+
+// Reads one JSON text. All functions return false once an error occurred,
+// error() describes the first one.
+class Reader {
+public:
+  Reader(const char *data, size_t size) : p_(data), end_(data + size) {}
+
+  // Reads the `{` of an object. Then call nextKey() until `more` is false.
+  bool beginObject();
+
+  // Reads the next key and its `:`, or the `}` of the object
+  bool nextKey(std::string *key, bool *more);
+
+  bool readString(std::string *value);
+  bool readBool(bool *value);
+  bool readInt(long long *value);
+
+  // Skips a value of any type, `begin` and `end` receive its text. The value
+  // is checked like any other, so the text is valid JSON.
+  bool skipValue(const char **begin = nullptr, const char **end = nullptr);
+
+  // Whether only whitespace is left
+  bool atEnd();
+
+  // Records an error found by the caller, e.g. an unexpected key
+  bool fail(const std::string &message);
+
+  const std::string &error() const { return error_; }
+
+private:
+  void SkipWhitespace();
+  bool Expect(char ch);
+  bool SkipValue(size_t depth);
+  bool SkipContainer(size_t depth);
+  bool SkipNumber();
+  bool SkipLiteral(const char *literal);
+  bool SkipString();
+
+  const char *p_;
+  const char *end_;
+  bool after_open_ = false;
+  std::string error_;
+};
+} // namespace Json
+
+#endif // CLI_JSON_H
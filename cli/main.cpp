@@ -1,52 +1,31 @@
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "batch.h"
+#include "file_utils.h"
 #include "html2md.h"
+#include "ndjson.h"
+
+#ifdef HTML2MD_SERVER
+#include "daemon.h"
+#include "http.h"
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using std::cerr;
 using std::cin;
 using std::cout;
 using std::endl;
-using std::fstream;
-using std::ifstream;
-using std::ios;
 using std::string;
-using std::stringstream;
-
-namespace FileUtils {
-bool exists(const std::string &name) {
-  ifstream f(name.c_str());
-  return f.good();
-}
-
-string readAll(const string &file) {
-  ifstream in(file);
-  stringstream buffer;
-  buffer << in.rdbuf();
-
-  if (in.bad()) {
-    throw std::runtime_error("Error reading file: " + file);
-  }
-
-  return buffer.str();
-}
-
-void writeFile(const string &file, const string &content) {
-  fstream out(file, ios::out);
-  if (!out.is_open()) {
-    throw std::runtime_error("Error writing file: " + file);
-  }
-
-  out << content;
-  out.close();
-
-  if (out.bad()) {
-    throw std::runtime_error("Error writing file: " + file);
-  }
-}
-} // namespace FileUtils
+using std::vector;
 
 constexpr const char *const DESCRIPTION =
     " [Options] files...\n\n"
@@ -54,26 +33,58 @@ constexpr const char *const DESCRIPTION =
     "Options:\n"
     "  -h, --help\tDisplays this help information.\n"
     "  -v, --version\tDisplay version information and exit.\n"
-    "  -o, --output\tSets the output file.\n"
+    "  -o, --output\tSets the output file, or the output directory when\n"
+    "\t\tconverting several files.\n"
     "  -i, --input\tSets the input text.\n"
     "  -p, --print\tPrint the generated Markdown.\n"
     "  -r, --replace\tOverwrite the output file (if it already exists) without "
-    "asking.\n";
+    "asking.\n"
+    "  -R, --recursive\tConvert the HTML files in the given directories.\n"
+    "  -j, --jobs\tNumber of files to convert at once (default: one per\n"
+    "\t\tCPU core).\n"
+    "  --ndjson\tRead JSON requests from standard input, one per line, and\n"
+    "\t\twrite the responses to standard output in the same order.\n";
 
   constexpr const char *const EXTRA_OPTIONS =
     "  -E, --preserve-entities\tKeep HTML entities (e.g. &nbsp;) in output.\n";
 
+#ifdef HTML2MD_SERVER
+constexpr const char *const SERVER_OPTIONS =
+    "  --serve\tServe conversions on the given Unix domain socket, with\n"
+    "\t\t-j worker threads.\n"
+    "  --connect\tConvert the input with the daemon listening on the given\n"
+    "\t\tsocket and write the Markdown to standard output or -o.\n"
+    "  --http\tServe conversions over HTTP on the given host:port, with\n"
+    "\t\t-j worker threads: POST the HTML to /convert.\n";
+#endif
+
+constexpr const char *const BATCH_NOTE =
+    "\nWith several files, directories or -j, every file is written next to\n"
+    "its input (or mirrored into the -o directory) with a .md extension.\n"
+    "\nThe file - converts standard input while it arrives and writes the\n"
+    "Markdown to standard output (or the -o file) as it is finished.\n";
+
 struct Options {
   bool print = false;
   bool replace = false;
   bool preserveEntities = false;
-  string inputFile;
+  bool recursive = false;
+  bool ndjson = false;
+  unsigned jobs = 0;
+  vector<string> inputFiles;
   string outputFile;
   string inputText;
+  string serve;
+  string connect;
+  string http;
 };
 
 void printHelp(const string &programName) {
   cout << programName << DESCRIPTION << EXTRA_OPTIONS;
+#ifdef HTML2MD_SERVER
+  cout << SERVER_OPTIONS;
+#endif
+  cout << BATCH_NOTE;
 }
 
 void printVersion() { cout << "Version " << VERSION << endl; }
@@ -121,6 +132,29 @@ Options parseCommandLine(int argc, char **argv) {
       options.replace = true;
     } else if (arg == "-E" || arg == "--preserve-entities") {
       options.preserveEntities = true;
+    } else if (arg == "-R" || arg == "--recursive") {
+      options.recursive = true;
+    } else if (arg == "--ndjson") {
+      options.ndjson = true;
+    } else if (arg == "--serve" || arg == "--connect" || arg == "--http") {
+      if (i + 1 < argc) {
+        (arg == "--serve"     ? options.serve
+         : arg == "--connect" ? options.connect
+                              : options.http) = argv[i + 1];
+        i++;
+      } else {
+        cerr << "The " << arg << " option requires an address!" << endl;
+        exit(EXIT_FAILURE);
+      }
+    } else if (arg == "-j" || arg == "--jobs") {
+      if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+        options.jobs = static_cast<unsigned>(std::atoi(argv[i + 1]));
+        i++;
+      } else {
+        cerr << "The " << arg << " option requires a number of threads!"
+             << endl;
+        exit(EXIT_FAILURE);
+      }
     } else if (arg == "-o" || arg == "--output") {
       if (i + 1 < argc) {
         options.outputFile = argv[i + 1];
@@ -137,50 +171,205 @@ Options parseCommandLine(int argc, char **argv) {
         cerr << "The" << arg << "option requires HTML text!" << endl;
         exit(EXIT_FAILURE);
       }
-    } else if (options.inputFile.empty()) {
-      options.inputFile = arg;
+    } else {
+      options.inputFiles.push_back(arg);
     }
   }
 
   return options;
 }
 
-int main(int argc, char **argv) {
-  Options options = parseCommandLine(argc, argv);
+// Don't turn \n into \r\n on Windows
+void setBinaryStdio() {
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+int convertStdin(const Options &options, html2md::Options *copt) {
+  // Standard input is the HTML, it can't be asked for confirmation
+  if (!options.outputFile.empty() && FileUtils::exists(options.outputFile) &&
+      !options.replace) {
+    cerr << options.outputFile << " already exists, use -r to overwrite it!"
+         << endl;
+    return EXIT_FAILURE;
+  }
+
+  setBinaryStdio();
+
+  try {
+    html2md::Converter converter(copt);
+
+    if (options.outputFile.empty()) {
+      FileUtils::convertStream(&converter, fileno(stdin), fileno(stdout));
+    } else {
+      FileUtils::OutputFile out(options.outputFile);
+      FileUtils::convertStream(&converter, fileno(stdin), out.fd());
+      out.close();
+    }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+#ifdef HTML2MD_SERVER
+int convertRemote(const Options &options) {
+  if (!options.outputFile.empty() && FileUtils::exists(options.outputFile) &&
+      !options.replace) {
+    cerr << options.outputFile << " already exists, use -r to overwrite it!"
+         << endl;
+    return EXIT_FAILURE;
+  }
 
-  string input;
-  if (!options.inputText.empty()) {
-    input = options.inputText;
-  } else if (!options.inputFile.empty() &&
-             FileUtils::exists(options.inputFile)) {
-    input = FileUtils::readAll(options.inputFile);
-  } else {
-    cerr << "No valid input provided!" << endl;
+  try {
+    Daemon::Client client(options.connect);
+
+    string md;
+    if (!options.inputText.empty()) {
+      md = client.convert(options.inputText.data(), options.inputText.size());
+    } else if (options.inputFiles.size() == 1) {
+      const string &name = options.inputFiles.front();
+      FileUtils::MappedFile file(name == "-" ? "/dev/stdin" : name);
+      md = client.convert(file.data(), file.size());
+    } else {
+      cerr << "No valid input provided!" << endl;
+      return EXIT_FAILURE;
+    }
+
+    if (options.outputFile.empty()) {
+      cout << md;
+    } else {
+      FileUtils::writeFile(options.outputFile, md);
+    }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
     return EXIT_FAILURE;
   }
 
+  return EXIT_SUCCESS;
+}
+#endif
+
+int main(int argc, char **argv) {
+  Options options = parseCommandLine(argc, argv);
+
   // Pass CLI-driven option to the converter
   html2md::Options copt;
   copt.keepHtmlEntities = options.preserveEntities;
-  html2md::Converter converter(input, &copt);
-  string md = converter.convert();
 
-  if (options.print) {
-    cout << md << endl;
+#ifdef HTML2MD_SERVER
+  if (!options.serve.empty()) {
+    Daemon::Options daemon;
+    daemon.path = options.serve;
+    daemon.jobs = options.jobs;
+    daemon.converter = copt;
+
+    return Daemon::serve(daemon) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (!options.connect.empty()) {
+    return convertRemote(options);
+  }
+
+  if (!options.http.empty()) {
+    Http::Options http;
+    http.address = options.http;
+    http.jobs = options.jobs;
+    http.converter = copt;
+
+    return Http::serve(http) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+#endif
+
+  if (options.ndjson) {
+    Ndjson::Options ndjson;
+    ndjson.jobs = options.jobs;
+    ndjson.converter = copt;
+
+    setBinaryStdio();
+
+    return Ndjson::run(ndjson, fileno(stdin), fileno(stdout)) ? EXIT_SUCCESS
+                                                              : EXIT_FAILURE;
   }
 
-  if (!options.outputFile.empty()) {
-    if (FileUtils::exists(options.outputFile) && !options.replace) {
-      if (confirmOverride(options.outputFile)) {
+  // `html2md -` converts standard input while it arrives
+  if (options.inputText.empty() && options.inputFiles.size() == 1 &&
+      options.inputFiles.front() == "-") {
+    return convertStdin(options, &copt);
+  }
+
+  if (options.inputText.empty() &&
+      (options.inputFiles.size() > 1 || options.recursive ||
+       options.jobs != 0)) {
+    if (options.print) {
+      cerr << "The -p option can't be used with -R, -j or several files!"
+           << endl;
+      return EXIT_FAILURE;
+    }
+
+    Batch::Options batch;
+    batch.inputs = options.inputFiles;
+    batch.outputDir = options.outputFile;
+    batch.recursive = options.recursive;
+    batch.replace = options.replace;
+    batch.jobs = options.jobs;
+    batch.converter = copt;
+
+    return Batch::run(batch) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  html2md::Converter converter(&copt);
+
+  // The converter borrows the HTML from argv or from the mapped file
+  std::unique_ptr<FileUtils::MappedFile> file;
+  try {
+    if (!options.inputText.empty()) {
+      converter.reset(options.inputText.data(), options.inputText.size());
+    } else if (options.inputFiles.size() == 1 &&
+               FileUtils::exists(options.inputFiles.front())) {
+      file.reset(new FileUtils::MappedFile(options.inputFiles.front()));
+      converter.reset(file->data(), file->size());
+    } else {
+      cerr << "No valid input provided!" << endl;
+      return EXIT_FAILURE;
+    }
+
+    bool write = !options.outputFile.empty();
+    if (write && FileUtils::exists(options.outputFile) && !options.replace &&
+        !confirmOverride(options.outputFile)) {
+      cout << "Markdown not written." << endl;
+      write = false;
+    }
+
+    // Writing the mapped input while converting it would change the HTML
+    bool in_place = write && file &&
+                    FileUtils::sameFile(options.inputFiles.front(),
+                                        options.outputFile);
+
+    if (options.print || in_place) {
+      string md = converter.convert();
+
+      if (options.print) {
+        cout << md << endl;
+      }
+
+      if (write) {
         FileUtils::writeFile(options.outputFile, md);
-        cout << "Markdown written to " << options.outputFile << endl;
-      } else {
-        cout << "Markdown not written." << endl;
       }
-    } else {
-      FileUtils::writeFile(options.outputFile, md);
+    } else if (write) {
+      FileUtils::convertToFile(&converter, options.outputFile);
+    }
+
+    if (write) {
       cout << "Markdown written to " << options.outputFile << endl;
     }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
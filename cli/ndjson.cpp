@@ -0,0 +1,320 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// The reader (the calling thread) hands the lines to a pool of converter
+// threads. Their responses go to a writer thread that puts them back into
+// input order. All queues are bounded, and the reader stays at most one
+// window ahead of the writer.
+
+#include "ndjson.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "converter_options.h"
+#include "file_utils.h"
+#include "json.h"
+#include "sink.h"
+
+using std::string;
+
+namespace {
+// Requests in flight if Options::window isn't set. Enough that the threads
+// don't have to wait for each other after every small request.
+constexpr size_t kWindow = 256;
+
+// Responses are collected up to this size before they are written
+constexpr size_t kWriteSize = 64 * 1024;
+
+// Longest request line if Options::max_line isn't set
+constexpr size_t kMaxLine = 64 * 1024 * 1024;
+
+struct Request {
+  size_t index;
+  string line;
+  // The line was skipped, its id is unknown
+  bool too_long;
+};
+
+struct Response {
+  size_t index;
+  string json;
+};
+
+// Blocks the reader while it's too far ahead of the writer
+class Window {
+public:
+  explicit Window(size_t size) : size_(size) {}
+
+  // Waits until request `index` is in the window, false after close()
+  bool enter(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    moved_.wait(lock, [&] { return index < written_ + size_ || closed_; });
+    return !closed_;
+  }
+
+  void advance(size_t written) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    written_ = written;
+    moved_.notify_all();
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    moved_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable moved_;
+  size_t size_;
+  size_t written_ = 0;
+  bool closed_ = false;
+};
+
+bool readOption(Json::Reader *reader, const string &name,
+                html2md::Options *options) {
+  using namespace ConverterOptions;
+
+  for (const auto &option : kBoolOptions)
+    if (name == option.name)
+      return reader->readBool(&(options->*option.member));
+
+  for (const auto &option : kIntOptions) {
+    if (name != option.name)
+      continue;
+
+    long long value;
+    if (!reader->readInt(&value))
+      return false;
+    if (value < -kMaxInt || value > kMaxInt)
+      return reader->fail(name + " is out of range");
+
+    options->*option.member = static_cast<int>(value);
+    return true;
+  }
+
+  for (const auto &option : kCharOptions) {
+    if (name != option.name)
+      continue;
+
+    string value;
+    if (!reader->readString(&value))
+      return false;
+    if (value.size() != 1)
+      return reader->fail(name + " has to be a single character");
+
+    options->*option.member = value[0];
+    return true;
+  }
+
+  return reader->fail("unknown option \"" + name + "\"");
+}
+
+bool readOptions(Json::Reader *reader, html2md::Options *options) {
+  string name;
+  bool more = true;
+
+  if (!reader->beginObject())
+    return false;
+
+  while (reader->nextKey(&name, &more)) {
+    if (!more)
+      return true;
+    if (!readOption(reader, name, options))
+      return false;
+  }
+
+  return false;
+}
+
+// Converts requests with a converter that is reused as long as the options
+// don't change
+class Worker {
+public:
+  explicit Worker(const html2md::Options &defaults) : defaults_(defaults) {}
+
+  // Returns the response line
+  string process(const string &line);
+
+private:
+  html2md::Options defaults_;
+  html2md::Options current_;
+  std::unique_ptr<html2md::Converter> converter_;
+};
+
+// The response to a request that can't be converted
+string failure(const string &id, const string &error) {
+  string response = "{\"id\":" + id;
+  response += ",\"markdown\":null,\"ok\":false,\"error\":";
+  Json::appendString(error.data(), error.size(), &response);
+  response += "}\n";
+  return response;
+}
+
+string Worker::process(const string &line) {
+  Json::Reader reader(line.data(), line.size());
+  html2md::Options options = defaults_;
+  string id = "null";
+  string html;
+  bool has_html = false;
+
+  string key;
+  bool more = true;
+  bool ok = reader.beginObject();
+  while (ok && (ok = reader.nextKey(&key, &more)) && more) {
+    if (key == "id") {
+      const char *begin;
+      const char *end;
+      ok = reader.skipValue(&begin, &end);
+      if (ok)
+        id.assign(begin, end);
+    } else if (key == "html") {
+      ok = has_html = reader.readString(&html);
+    } else if (key == "options") {
+      ok = readOptions(&reader, &options);
+    } else {
+      ok = reader.skipValue();
+    }
+  }
+
+  if (ok && !reader.atEnd())
+    ok = reader.fail("unexpected text after the object");
+  if (ok && !has_html)
+    ok = reader.fail("missing \"html\"");
+
+  string md;
+  string error = reader.error();
+  if (ok) {
+    try {
+      if (!converter_ || !(current_ == options)) {
+        current_ = options;
+        converter_.reset(new html2md::Converter(&current_));
+      }
+
+      converter_->reset(html.data(), html.size());
+      md = converter_->convert();
+    } catch (const std::exception &e) {
+      ok = false;
+      error = e.what();
+    }
+  }
+
+  if (!ok)
+    return failure(id, error);
+
+  string response = "{\"id\":" + id + ",\"markdown\":";
+  Json::appendString(md.data(), md.size(), &response);
+  response += ",\"ok\":true}\n";
+  return response;
+}
+} // namespace
+
+namespace Ndjson {
+bool run(const Options &options, int in, int out) {
+  unsigned jobs = options.jobs;
+  if (jobs == 0)
+    jobs = std::thread::hardware_concurrency();
+  if (jobs == 0)
+    jobs = 1;
+
+  size_t window_size = options.window;
+  if (window_size == 0)
+    window_size = std::max<size_t>(kWindow, 4 * jobs);
+
+  size_t max_line = options.max_line != 0 ? options.max_line : kMaxLine;
+  string too_long =
+      failure("null", "line longer than " + std::to_string(max_line) +
+                          " bytes");
+
+  BoundedQueue<Request> requests(window_size);
+  BoundedQueue<Response> responses(window_size);
+  Window window(window_size);
+  bool write_failed = false;
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < jobs; ++i)
+    workers.emplace_back([&] {
+      Worker worker(options.converter);
+      Request request;
+
+      while (requests.pop(&request))
+        responses.push({request.index, request.too_long
+                                           ? too_long
+                                           : worker.process(request.line)});
+    });
+
+  std::thread writer([&] {
+    html2md::FdSink sink(out);
+    std::map<size_t, string> waiting;
+    size_t next = 0;
+    string ready;
+
+    Response response;
+    while (responses.pop(&response)) {
+      // Write all responses that are done with one call
+      do {
+        waiting.emplace(response.index, std::move(response.json));
+
+        // Everything that follows the last written response in order
+        auto it = waiting.begin();
+        for (; it != waiting.end() && it->first == next; ++it, ++next)
+          ready += it->second;
+        waiting.erase(waiting.begin(), it);
+      } while (ready.size() < kWriteSize && responses.tryPop(&response));
+
+      if (ready.empty() || write_failed)
+        continue;
+
+      sink.write(ready.data(), ready.size());
+      ready.clear();
+      window.advance(next);
+
+      // Keep taking responses, so the workers don't block, but stop reading
+      if (!sink.ok()) {
+        write_failed = true;
+        window.close();
+      }
+    }
+  });
+
+  bool read_failed = false;
+  try {
+    FileUtils::LineReader reader(in, max_line);
+    string line;
+
+    for (size_t index = 0; reader.next(&line);) {
+      if (!reader.tooLong() && line.find_first_not_of(" \t") == string::npos)
+        continue;
+
+      if (!window.enter(index))
+        break;
+      requests.push({index++, std::move(line), reader.tooLong()});
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    read_failed = true;
+  }
+
+  requests.close();
+  for (auto &worker : workers)
+    worker.join();
+
+  responses.close();
+  writer.join();
+
+  if (write_failed)
+    std::cerr << "Error writing output" << std::endl;
+
+  return !read_failed && !write_failed;
+}
+} // namespace Ndjson
@@ -0,0 +1,41 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_NDJSON_H
+#define CLI_NDJSON_H
+
+#include <cstddef>
+
+#include "html2md.h"
+
+// Converts a stream of JSON requests, one per line:
+//
+//   {"id": 1, "html": "<b>x</b>", "options": {"splitLines": false}}
+//
+// and writes one response per request, in the same order:
+//
+//   {"id":1,"markdown":"**x**\n","ok":true}
+//   {"id":2,"markdown":null,"ok":false,"error":"missing \"html\""}
+//
+// The id is copied unchanged and can be any JSON value. The options have the
+// names of the members of html2md::Options.
+namespace Ndjson {
+struct Options {
+  // Number of converter threads, 0 uses one per hardware thread
+  unsigned jobs = 0;
+  // Requests read ahead of the oldest one that isn't written yet, 0 uses a
+  // default
+  size_t window = 0;
+  // Longest request line in bytes, 0 uses a default. A longer line gets an
+  // error response with a null id.
+  size_t max_line = 0;
+  // Defaults for the options of every request
+  html2md::Options converter;
+};
+
+// Reads requests from `in` until it ends and writes the responses to `out`.
+// Returns false if reading or writing failed.
+bool run(const Options &options, int in, int out);
+} // namespace Ndjson
+
+#endif // CLI_NDJSON_H
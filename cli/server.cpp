@@ -0,0 +1,408 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace {
+// More connections are left waiting in the listen backlog
+constexpr size_t kMaxConnections = 1024;
+
+// Bytes asked for per receive()
+constexpr size_t kReceiveSize = 64 * 1024;
+
+// A request has to arrive and its response has to be sent within this time,
+// counted from its first byte. Slow clients can't keep a worker longer.
+constexpr std::chrono::seconds kRequestTimeout(60);
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+void setCloseOnExec(int fd) { ::fcntl(fd, F_SETFD, FD_CLOEXEC); }
+
+void setNonBlocking(int fd) {
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+// Responses are sent with one call, there is no point in waiting for more.
+// Fails harmlessly on Unix domain sockets.
+void setNoDelay(int fd) {
+  int on = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+Server::Server *running = nullptr;
+
+void stopRunning(int) {
+  if (running)
+    running->stop();
+}
+} // namespace
+
+namespace Server {
+Connection::~Connection() { ::close(fd_); }
+
+bool Connection::receive() {
+  for (;;) {
+    ssize_t n = Receive(0);
+    if (n >= 0)
+      return n > 0;
+
+    if (errno != EINTR && (!wouldBlock() || !Wait(POLLIN)))
+      return false;
+  }
+}
+
+bool Connection::receiveAvailable() {
+  ssize_t n;
+  do {
+    n = Receive(MSG_DONTWAIT);
+  } while (n < 0 && errno == EINTR);
+
+  return n > 0 || (n < 0 && wouldBlock());
+}
+
+ssize_t Connection::Receive(int flags) {
+  // Drop what was consumed, unless that would move a lot of data
+  if (begin_ == buffer_.size()) {
+    buffer_.clear();
+    begin_ = 0;
+  } else if (begin_ >= kReceiveSize && begin_ >= buffer_.size() / 2) {
+    buffer_.erase(0, begin_);
+    begin_ = 0;
+  }
+
+  size_t size = buffer_.size();
+  buffer_.resize(size + kReceiveSize);
+
+  ssize_t n = ::recv(fd_, &buffer_[size], kReceiveSize, flags);
+  int saved_errno = errno;
+
+  buffer_.resize(size + (n > 0 ? static_cast<size_t>(n) : 0));
+  errno = saved_errno;
+  return n;
+}
+
+bool Connection::Wait(short events) const {
+  for (;;) {
+    int timeout = -1;
+    if (has_deadline_) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline_ - Clock::now());
+      if (left.count() <= 0)
+        return false;
+      timeout = static_cast<int>(std::min<long long>(left.count(), INT_MAX));
+    }
+
+    pollfd fd = {fd_, events, 0};
+    int n = ::poll(&fd, 1, timeout);
+    if (n > 0)
+      return true;
+    if (n < 0 && errno != EINTR)
+      return false;
+  }
+}
+
+bool Connection::receive(size_t size) {
+  while (this->size() < size)
+    if (!receive())
+      return false;
+
+  return true;
+}
+
+bool Connection::send(const char *data, size_t size, const char *more,
+                      size_t more_size) {
+  iovec parts[2] = {{const_cast<char *>(data), size},
+                    {const_cast<char *>(more), more_size}};
+  iovec *part = parts;
+  size_t count = more_size != 0 ? 2 : 1;
+
+  while (count != 0) {
+    msghdr message = {};
+    message.msg_iov = part;
+    message.msg_iovlen = count;
+
+    ssize_t n = ::sendmsg(fd_, &message, kSendFlags);
+    if (n < 0) {
+      if (errno == EINTR || (wouldBlock() && Wait(POLLOUT)))
+        continue;
+      return false;
+    }
+
+    // Skip what was sent
+    size_t sent = static_cast<size_t>(n);
+    while (count != 0 && sent >= part->iov_len) {
+      sent -= part->iov_len;
+      ++part;
+      --count;
+    }
+    if (count != 0) {
+      part->iov_base = static_cast<char *>(part->iov_base) + sent;
+      part->iov_len -= sent;
+    }
+  }
+
+  return true;
+}
+
+Server::Server(int listen_fd, Handler *handler, unsigned threads,
+               const html2md::Options &options)
+    : listen_fd_(listen_fd), handler_(handler), options_(options),
+      threads_(threads), ready_(kMaxConnections) {
+  if (threads_ == 0)
+    threads_ = std::thread::hardware_concurrency();
+  if (threads_ == 0)
+    threads_ = 1;
+
+  if (::pipe(wake_) != 0)
+    throw std::runtime_error("Can't create a pipe");
+
+  for (int fd : wake_) {
+    setCloseOnExec(fd);
+    setNonBlocking(fd);
+  }
+}
+
+Server::~Server() {
+  for (auto *connection : returned_)
+    delete connection;
+
+  ::close(wake_[0]);
+  ::close(wake_[1]);
+  ::close(listen_fd_);
+}
+
+void Server::run() {
+  for (unsigned i = 0; i < threads_; ++i)
+    workers_.emplace_back(&Server::Work, this);
+
+  Poll();
+
+  // Queued requests are dropped. Requests that are being handled are cut
+  // off, the workers might wait for their clients otherwise.
+  ready_.close();
+  {
+    std::lock_guard<std::mutex> lock(busy_mutex_);
+    for (auto *connection : busy_)
+      ::shutdown(connection->fd(), SHUT_RDWR);
+  }
+
+  for (auto &worker : workers_)
+    worker.join();
+  workers_.clear();
+  idle_.clear();
+}
+
+void Server::runUntilSignal() {
+  // A client that disconnects early makes send() fail instead
+  std::signal(SIGPIPE, SIG_IGN);
+
+  running = this;
+  std::signal(SIGINT, stopRunning);
+  std::signal(SIGTERM, stopRunning);
+
+  run();
+
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  running = nullptr;
+}
+
+void Server::stop() {
+  stopping_ = true;
+  Wake();
+}
+
+void Server::Poll() {
+  std::vector<pollfd> fds;
+
+  while (!stopping_) {
+    // Take the connections back that the workers are done with
+    {
+      std::lock_guard<std::mutex> lock(returned_mutex_);
+      for (auto *connection : returned_) {
+        // The deadline was for the request that was just answered
+        connection->clearDeadline();
+
+        // Pipelined requests don't need to wait for poll()
+        if (handler_->ready(connection)) {
+          Dispatch(connection);
+          continue;
+        }
+
+        if (connection->size() != 0)
+          connection->setDeadline(Connection::Clock::now() + kRequestTimeout);
+        idle_.emplace_back(connection);
+      }
+      returned_.clear();
+    }
+
+    bool accepting = connections_ - closed_ < kMaxConnections;
+
+    // Wake up for the first partial request that runs out of time
+    auto now = Connection::Clock::now();
+    int timeout = -1;
+    fds.clear();
+    fds.push_back({wake_[0], POLLIN, 0});
+    fds.push_back({accepting ? listen_fd_ : -1, POLLIN, 0});
+    for (const auto &connection : idle_) {
+      fds.push_back({connection->fd(), POLLIN, 0});
+
+      if (connection->hasDeadline()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            connection->deadline() - now);
+        int ms = static_cast<int>(std::max<long long>(left.count() + 1, 0));
+        if (timeout < 0 || ms < timeout)
+          timeout = ms;
+      }
+    }
+
+    if (::poll(fds.data(), fds.size(), timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+
+      std::cerr << "poll() failed: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    if (fds[0].revents != 0) {
+      char buffer[64];
+      while (::read(wake_[0], buffer, sizeof(buffer)) > 0) {
+      }
+    }
+
+    // Connections with a complete request go to the workers, closed ones and
+    // those that took too long to send a request are dropped
+    now = Connection::Clock::now();
+    size_t kept = 0;
+    for (size_t i = 0; i < idle_.size(); ++i) {
+      Connection *connection = idle_[i].get();
+      bool readable = fds[i + 2].revents != 0;
+
+      if (!readable && connection->hasDeadline() &&
+          connection->deadline() <= now)
+        Close(idle_[i].release());
+      else if (readable && !ReadIdle(connection))
+        idle_[i].release(); // Dispatched or closed
+      else
+        idle_[kept++] = std::move(idle_[i]);
+    }
+    idle_.resize(kept);
+
+    if (fds[1].revents & POLLIN) {
+      int fd = ::accept(listen_fd_, nullptr, nullptr);
+      if (fd >= 0) {
+        setCloseOnExec(fd);
+        setNonBlocking(fd);
+        setNoDelay(fd);
+        idle_.emplace_back(new Connection(fd));
+        ++connections_;
+      }
+    }
+  }
+}
+
+bool Server::ReadIdle(Connection *connection) {
+  if (!connection->receiveAvailable()) {
+    Close(connection);
+    return false;
+  }
+
+  if (handler_->ready(connection)) {
+    Dispatch(connection);
+    return false;
+  }
+
+  // The request started, it has to be complete in time
+  if (!connection->hasDeadline())
+    connection->setDeadline(Connection::Clock::now() + kRequestTimeout);
+  return true;
+}
+
+void Server::Work() {
+  html2md::Options options = options_;
+  html2md::Converter converter(&options);
+
+  Connection *connection;
+  while (ready_.pop(&connection)) {
+    bool keep = false;
+    if (!stopping_) {
+      try {
+        keep = handler_->handle(connection, &converter);
+      } catch (const std::exception &e) {
+        std::cerr << "Closing a connection: " << e.what() << std::endl;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(busy_mutex_);
+      busy_.erase(connection);
+    }
+
+    if (keep) {
+      Return(connection);
+    } else {
+      Close(connection);
+      // The polling thread might wait to accept more connections
+      Wake();
+    }
+  }
+}
+
+void Server::Return(Connection *connection) {
+  {
+    std::lock_guard<std::mutex> lock(returned_mutex_);
+    returned_.push_back(connection);
+  }
+
+  Wake();
+}
+
+void Server::Dispatch(Connection *connection) {
+  if (!connection->hasDeadline())
+    connection->setDeadline(Connection::Clock::now() + kRequestTimeout);
+
+  {
+    std::lock_guard<std::mutex> lock(busy_mutex_);
+    busy_.insert(connection);
+  }
+
+  // Can't block, there are never more connections than fit into the queue
+  ready_.push(connection);
+}
+
+void Server::Close(Connection *connection) {
+  delete connection;
+  ++closed_;
+}
+
+void Server::Wake() {
+  // Only async-signal-safe calls, see stop(). A full pipe wakes up poll() as
+  // well, so a failed write doesn't matter.
+  char byte = 0;
+  (void)!::write(wake_[1], &byte, 1);
+}
+} // namespace Server
@@ -0,0 +1,176 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef CLI_SERVER_H
+#define CLI_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "html2md.h"
+
+// A server for the long-running CLI modes. One thread waits for connections
+// and reads from them until the start of a request (e.g. its header) is
+// complete. Only then is the connection handed to a worker thread, which
+// handles that request with its own, reused converter and then hands the
+// connection back. So a worker is only busy while there is work, however many
+// idle or slow connections are kept open. Every request has to arrive and be
+// answered within a deadline, however slowly the client sends or reads.
+//
+// Only available on POSIX systems.
+namespace Server {
+// A client connection, owned by one worker while it handles a request
+class Connection {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Connection(int fd) : fd_(fd) {}
+  ~Connection();
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  int fd() const { return fd_; }
+
+  // Received bytes that weren't consumed yet
+  const char *data() const { return buffer_.data() + begin_; }
+  size_t size() const { return buffer_.size() - begin_; }
+  void consume(size_t size) {
+    begin_ += size;
+    checked_ = 0;
+  }
+
+  // How much of data() a Handler already looked at, reset by consume()
+  size_t checked() const { return checked_; }
+  void setChecked(size_t checked) { checked_ = checked; }
+
+  // Receiving and sending fail once the deadline passed. Without one they
+  // wait as long as it takes.
+  void setDeadline(Clock::time_point deadline) {
+    deadline_ = deadline;
+    has_deadline_ = true;
+  }
+  void clearDeadline() { has_deadline_ = false; }
+  bool hasDeadline() const { return has_deadline_; }
+  Clock::time_point deadline() const { return deadline_; }
+
+  // Receives more bytes, false if the peer closed the connection or an error
+  // (e.g. the deadline passed) occurred
+  bool receive();
+
+  // Receives what is available without waiting, false if the peer closed the
+  // connection or an error occurred. The socket has to be non-blocking.
+  bool receiveAvailable();
+
+  // Receives until at least `size` bytes are buffered
+  bool receive(size_t size);
+
+  // Sends both parts with as few calls as possible
+  bool send(const char *data, size_t size, const char *more = nullptr,
+            size_t more_size = 0);
+
+private:
+  // Makes room for and appends one recv(), returns its result
+  ssize_t Receive(int flags);
+
+  // Waits until the socket is ready for `events`, false at the deadline
+  bool Wait(short events) const;
+
+  int fd_;
+  std::string buffer_;
+  size_t begin_ = 0;
+  size_t checked_ = 0;
+  Clock::time_point deadline_;
+  bool has_deadline_ = false;
+};
+
+// The protocol
+class Handler {
+public:
+  virtual ~Handler() = default;
+
+  // Whether enough of the next request is buffered to start handling it
+  // without waiting for the client, e.g. its header. Called on the polling
+  // thread, it must not block. A request that can't be valid counts as ready
+  // too, so that the worker can answer it.
+  virtual bool ready(Connection *connection) const {
+    return connection->size() != 0;
+  }
+
+  // Handles one request, called on a worker thread once ready() returned
+  // true. Returns false to close the connection.
+  virtual bool handle(Connection *connection,
+                      html2md::Converter *converter) = 0;
+};
+
+class Server {
+public:
+  // Serves the connections accepted on `listen_fd` (which is closed by the
+  // destructor) on `threads` workers, 0 uses one per hardware thread
+  Server(int listen_fd, Handler *handler, unsigned threads,
+         const html2md::Options &options);
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Serves until stop() is called
+  void run();
+
+  // Serves until stop() is called or the process gets SIGINT or SIGTERM
+  void runUntilSignal();
+
+  // Can be called from any thread and from signal handlers. Requests that are
+  // being handled are cut off.
+  void stop();
+
+private:
+  void Poll();
+  void Work();
+  void Return(Connection *connection);
+  void Dispatch(Connection *connection);
+  void Close(Connection *connection);
+  void Wake();
+
+  // Reads from an idle connection that poll() found readable. Returns false
+  // if the connection was dispatched or closed.
+  bool ReadIdle(Connection *connection);
+
+  int listen_fd_;
+  Handler *handler_;
+  html2md::Options options_;
+  unsigned threads_;
+
+  // Wakes up the polling thread, written by stop() and Return()
+  int wake_[2];
+  std::atomic<bool> stopping_{false};
+
+  // Connections waiting for a request, only used by the polling thread
+  std::vector<std::unique_ptr<Connection>> idle_;
+  size_t connections_ = 0;
+
+  // Connections with a request, waiting for a worker or being handled. The
+  // mutex also keeps them open while they are shut down.
+  BoundedQueue<Connection *> ready_;
+  std::mutex busy_mutex_;
+  std::unordered_set<Connection *> busy_;
+
+  // Connections the workers are done with
+  std::mutex returned_mutex_;
+  std::vector<Connection *> returned_;
+  std::atomic<size_t> closed_{0};
+
+  std::vector<std::thread> workers_;
+};
+} // namespace Server
+
+#endif // CLI_SERVER_H
@@ -0,0 +1,143 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef BATCH_CONVERTER_H
+#define BATCH_CONVERTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "html2md.h"
+
+namespace html2md {
+
+/*!
+ * \brief Converts many documents on a pool of worker threads
+ *
+ * Every worker has its own Converter, which is reused for all documents it
+ * converts, and its own queue of documents. A worker that runs out of work
+ * takes documents from the end of another worker's queue, so a few huge
+ * documents don't leave the other threads idle.
+ *
+ * The results come back in input order, either as futures (submit()) or
+ * through a callback (convert()).
+ *
+ * ```cpp
+ * html2md::BatchConverter batch;
+ * std::vector<std::string> md = batch.convert(pages);
+ * ```
+ *
+ * All functions can be called from any thread, also at the same time. Don't
+ * call convert() from the callback of another convert(), it would wait for a
+ * worker that is busy waiting.
+ */
+class BatchConverter {
+public:
+  /*!
+   * \brief Called with the Markdown of the input at `index`.
+   *
+   * The callback is called in input order, never for two inputs at the same
+   * time, from one of the worker threads.
+   */
+  using Callback = std::function<void(size_t index, std::string &&md)>;
+
+  /*!
+   * \brief Starts the worker threads.
+   * \param threads Number of workers, 0 uses one per hardware thread.
+   * \param options Options for all conversions.
+   */
+  explicit BatchConverter(unsigned threads = 0, Options options = Options());
+
+  /*!
+   * \brief Finishes the queued documents and stops the workers.
+   */
+  ~BatchConverter();
+
+  BatchConverter(const BatchConverter &) = delete;
+  BatchConverter &operator=(const BatchConverter &) = delete;
+
+  /*!
+   * \brief Queue documents and return immediately.
+   * \param inputs Pointer to the first HTML document.
+   * \param count Number of documents.
+   * \return One future per document, in input order.
+   *
+   * \warning The documents are not copied. They have to stay valid (and
+   * unchanged) until their futures are ready.
+   */
+  [[nodiscard]] std::vector<std::future<std::string>>
+  submit(const std::string *inputs, size_t count);
+
+  /*!
+   * \brief Convert documents and wait until all of them are done.
+   * \param inputs Pointer to the first HTML document.
+   * \param count Number of documents.
+   * \param callback Receives the Markdown, in input order.
+   *
+   * If a conversion throws, the callback isn't called for that document and
+   * the exception is rethrown once the others are done. The same goes for the
+   * first exception thrown by the callback. Returns after the last callback
+   * returned.
+   */
+  void convert(const std::string *inputs, size_t count,
+               const Callback &callback);
+
+  /*!
+   * \brief Convert documents and wait until all of them are done.
+   * \param inputs The HTML documents.
+   * \return The Markdown, in input order.
+   */
+  [[nodiscard]] std::vector<std::string>
+  convert(const std::vector<std::string> &inputs);
+
+  /*!
+   * \brief Number of worker threads.
+   */
+  [[nodiscard]] size_t threads() const { return workers_.size(); }
+
+private:
+  struct Batch;
+
+  struct Task {
+    std::shared_ptr<Batch> batch;
+    size_t index;
+  };
+
+  // The owner takes documents from the front, so they are converted roughly
+  // in input order, other workers steal from the back.
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Enqueue(const std::shared_ptr<Batch> &batch);
+  void Work(size_t worker);
+  bool TakeTask(size_t worker, Task *task);
+  void Run(Converter *converter, const Task &task);
+
+  Options options_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // Sleeping workers wait for queued_ to become non-zero
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::atomic<size_t> queued_{0};
+  bool stopping_ = false;
+
+  // Queue that gets the next document of a batch
+  std::atomic<size_t> next_queue_{0};
+};
+
+} // namespace html2md
+
+#endif // BATCH_CONVERTER_H
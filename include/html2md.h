@@ -4,11 +4,18 @@
 #ifndef HTML2MD_H
 #define HTML2MD_H
 
-#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <cstdint>
 
+#include "sink.h"
+#include "table.h"
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#endif
+
 /*!
  * \brief html2md namespace
  *
@@ -107,6 +114,19 @@ struct Options {
    */
   bool formatTable = true;
 
+  /*!
+   * \brief Measure formatted tables on their first rows only
+   *
+   * With formatTable, a whole table is kept in memory until its column widths
+   * are known. If this is set to N > 0, the widths are taken from the first N
+   * rows and every later row is padded to them and written right away, so a
+   * table of any length needs constant memory (see Converter::setSink()).
+   * Longer cells in later rows are written in full, the table stays valid but
+   * isn't aligned there.
+   * Default is 0 (measure the whole table).
+   */
+  int tableSampleRows = 0;
+
   /*!
    * \brief Whether to force left trim of lines in the final Markdown output
    *
@@ -145,7 +165,9 @@ struct Options {
     return splitLines == o.splitLines && unorderedList == o.unorderedList &&
            orderedList == o.orderedList && includeTitle == o.includeTitle &&
            softBreak == o.softBreak && hardBreak == o.hardBreak &&
-           formatTable == o.formatTable && forceLeftTrim == o.forceLeftTrim &&
+           formatTable == o.formatTable &&
+           tableSampleRows == o.tableSampleRows &&
+           forceLeftTrim == o.forceLeftTrim &&
            compressWhitespace == o.compressWhitespace &&
            escapeNumberedList == o.escapeNumberedList &&
            keepHtmlEntities == o.keepHtmlEntities;
@@ -194,6 +216,14 @@ struct Options {
  * if (!c.ok()) std::cout << "There was something wrong in the HTML\n";
  * std::cout << md; // # example
  * ```
+ *
+ * ## Thread safety
+ *
+ * All state of a conversion is kept in its Converter, the library has no
+ * mutable global state. Different instances can be used from different
+ * threads at the same time without locking, html2md::Convert() can be called
+ * from any thread. A single instance must not be used by more than one thread
+ * at a time.
  */
 class Converter {
 public:
@@ -209,10 +239,56 @@ public:
    * You can use appendToMd() to append something to the beginning of the
    * generated output.
    */
-  explicit inline Converter(const std::string &html,
-                            struct Options *options = nullptr) {
-    *this = Converter(&html, options);
-  }
+  explicit Converter(const std::string &html,
+                     struct Options *options = nullptr);
+
+  /*!
+   * \brief Creates a Converter without HTML.
+   * \param options Options for the conversion.
+   *
+   * Pass the HTML later with feed() or convert(const std::string &).
+   */
+  explicit Converter(struct Options *options = nullptr);
+
+  /*!
+   * \brief Takes over the HTML without copying it.
+   * \param html The HTML as std::string.
+   * \param options Options for the conversion.
+   */
+  explicit Converter(std::string &&html, struct Options *options = nullptr);
+
+  /*!
+   * \brief Copies the null-terminated HTML, like the std::string initializer.
+   * \param html The HTML as C string.
+   * \param options Options for the conversion.
+   */
+  explicit Converter(const char *html, struct Options *options = nullptr);
+
+  /*!
+   * \brief Borrows the HTML instead of copying it.
+   * \param html Pointer to the HTML, doesn't need to be null-terminated.
+   * \param size Length of the HTML in bytes.
+   * \param options Options for the conversion.
+   *
+   * Useful for memory-mapped files and network buffers.
+   *
+   * \warning The buffer is not copied. It has to stay valid (and unchanged)
+   * until the last call to convert() has returned.
+   */
+  Converter(const char *html, size_t size, struct Options *options = nullptr);
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+  /*!
+   * \brief Borrows the HTML instead of copying it.
+   * \param html View of the HTML.
+   * \param options Options for the conversion.
+   *
+   * \warning The viewed string has to stay valid (and unchanged) until the
+   * last call to convert() has returned.
+   */
+  explicit Converter(std::string_view html, struct Options *options = nullptr)
+      : Converter(html.data(), html.size(), options) {}
+#endif
 
   /*!
    * \brief Convert HTML into Markdown.
@@ -223,6 +299,94 @@ public:
    */
   [[nodiscard]] std::string convert();
 
+  /*!
+   * \brief Convert another HTML document with the same instance.
+   * \param html The HTML, copied like in the std::string initializer.
+   * \return Returns the converted Markdown.
+   *
+   * Same as calling reset(const std::string &) followed by convert(). The
+   * buffers of the previous conversion are reused, so converting many
+   * documents with one Converter allocates (almost) nothing once the buffers
+   * are big enough. Options and HTML symbol conversions are kept.
+   */
+  [[nodiscard]] std::string convert(const std::string &html);
+
+  /*!
+   * \brief Convert a large document on several threads.
+   * \param threads Number of threads, 0 uses one per hardware thread.
+   * \return Returns the converted Markdown, byte for byte the same as
+   * convert().
+   *
+   * The HTML is split in front of top-level blocks (`<p>`, `<h1>`-`<h6>`,
+   * `<table>`, `<div>` and `<section>` outside of lists, blockquotes, `<pre>`
+   * and tables) and the parts are converted at the same time. Each part is
+   * started with the HTML in front of it, and the state at its start is
+   * compared with the state the previous part ended with. A part whose state
+   * doesn't match is converted again, continuing the previous one. The cleanup
+   * is split at line breaks and checked the same way.
+   *
+   * Documents with less than 256 KiB per thread and conversions with a sink
+   * (see setSink()) are passed to convert().
+   */
+  [[nodiscard]] std::string convertParallel(unsigned threads = 0);
+
+  /*!
+   * \brief Convert the next chunk of a streamed HTML document.
+   * \param chunk Pointer to the chunk, doesn't need to be null-terminated.
+   * \param size Length of the chunk in bytes.
+   *
+   * Chunks can be split anywhere, even inside of tags, attributes or
+   * entities. The chunk is not needed anymore once feed() returns, only the
+   * unfinished tag (if any) is kept. The first call starts a new document.
+   *
+   * ```cpp
+   * html2md::Converter c;
+   * ssize_t n;
+   * while ((n = read(fd, buf, sizeof(buf))) > 0) c.feed(buf, n);
+   * auto md = c.finish();
+   * ```
+   */
+  void feed(const char *chunk, size_t size);
+
+  /*!
+   * \brief Convert the next chunk of a streamed HTML document.
+   * \param chunk The chunk.
+   */
+  inline void feed(const std::string &chunk) {
+    feed(chunk.data(), chunk.size());
+  }
+
+  /*!
+   * \brief End the streamed document.
+   * \return Returns the converted Markdown.
+   *
+   * Cleans up the Markdown like convert() does. ok() tells whether every tag
+   * was closed.
+   */
+  std::string finish();
+
+  /*!
+   * \brief Write the Markdown to a sink while converting.
+   * \param sink The sink, not owned. Pass nullptr to collect the Markdown
+   * again.
+   * \param flush_threshold Check for finished Markdown whenever this many
+   * bytes have been generated since the last check.
+   *
+   * Parts of the Markdown are written as soon as they can't change anymore,
+   * so only the unfinished end (e.g. an open table) is kept in memory. Together
+   * with feed() a document can be converted without ever holding it or its
+   * Markdown completely. convert() and finish() write the rest and return an
+   * empty string.
+   *
+   * ```cpp
+   * html2md::OstreamSink out(std::cout);
+   * html2md::Converter c(html);
+   * c.setSink(&out);
+   * c.convert();
+   * ```
+   */
+  void setSink(Sink *sink, size_t flush_threshold = 16384);
+
   /*!
    * \brief Append a char to the Markdown.
    * \param ch The char to append.
@@ -237,6 +401,14 @@ public:
    */
   Converter *appendToMd(const char *str);
 
+  /*!
+   * \brief Append part of a char* to the Markdown.
+   * \param str The chars to append, don't have to be null-terminated.
+   * \param size Number of chars to append.
+   * \return Returns a copy of the instance with the chars appended.
+   */
+  Converter *appendToMd(const char *str, size_t size);
+
   /*!
    * \brief Append a string to the Markdown.
    * \param s The string to append.
@@ -263,6 +435,8 @@ public:
     * \note This is useful for converting HTML entities to their Markdown
     * equivalents. For example, you can add a conversion for "&nbsp;" to
     * " " (space) or "&lt;" to "<" (less than).
+    * \note All HTML5 character references (`&mdash;`, `&#8217;`, ...) are
+    * decoded by default, conversions take precedence over them.
     * \note This is not a standard feature of the Converter class, but it can
     * be added to the class to allow for more flexibility in the conversion
     * process. You can use this feature to add custom conversions for any HTML
@@ -271,23 +445,32 @@ public:
   void addHtmlSymbolConversion(const std::string &htmlSymbol,
                                const std::string &replacement) {
     htmlSymbolConversions_[htmlSymbol] = replacement;
+    symbol_trie_dirty_ = true;
   }
 
   /*!
    * \brief Remove an HTML symbol conversion
    * \param htmlSymbol The HTML symbol to remove
    * \note This is useful for removing custom conversions that you have added
-   * previously.
+   * previously. Removed character references (like `&amp;`) are kept as they
+   * are.
    */
   void removeHtmlSymbolConversion(const std::string &htmlSymbol) {
-    htmlSymbolConversions_.erase(htmlSymbol);
+    // Converting the symbol into itself also overrides the character reference
+    htmlSymbolConversions_[htmlSymbol] = htmlSymbol;
+    symbol_trie_dirty_ = true;
   }
 
   /*!
    * \brief Clear all HTML symbol conversions
    * \note This is useful for clearing the conversion map (it's empty afterwards).
+   * Character references aren't decoded anymore either.
    */
-  void clearHtmlSymbolConversions() { htmlSymbolConversions_.clear(); }
+  void clearHtmlSymbolConversions() {
+    htmlSymbolConversions_.clear();
+    decode_character_references_ = false;
+    symbol_trie_dirty_ = true;
+  }
 
   /*!
    * \brief Checks if everything was closed properly(in the HTML).
@@ -297,10 +480,30 @@ public:
   [[nodiscard]] bool ok() const;
 
   /*!
-   * \brief Reset the generated Markdown
+   * \brief Reset the generated Markdown and the parser state, the next call to
+   * convert() converts the HTML again.
    */
   void reset();
 
+  /*!
+   * \brief Reset everything and replace the HTML.
+   * \param html The new HTML, copied into the buffer of the old one.
+   *
+   * Options and HTML symbol conversions are kept, the capacity of all
+   * buffers too.
+   */
+  void reset(const std::string &html);
+
+  /*!
+   * \brief Reset everything and borrow the new HTML instead of copying it.
+   * \param html Pointer to the HTML, doesn't need to be null-terminated.
+   * \param size Length of the HTML in bytes.
+   *
+   * \warning The buffer is not copied. It has to stay valid (and unchanged)
+   * until the last call to convert() has returned.
+   */
+  void reset(const char *html, size_t size);
+
   /*!
    * \brief Checks if the HTML matches and the options are the same.
    * \param The Converter object to compare with
@@ -309,7 +512,10 @@ public:
   inline bool operator==(const Converter *c) const { return *this == *c; }
 
   inline bool operator==(const Converter &c) const {
-    return html_ == c.html_ && option == c.option;
+    return html_size_ == c.html_size_ &&
+           std::char_traits<char>::compare(html(), c.html(), html_size_) ==
+               0 &&
+           option == c.option;
   }
 
   /*!
@@ -376,6 +582,55 @@ private:
   static constexpr const char *kTagTableHeader = "th";
   static constexpr const char *kTagTableData = "td";
 
+  // Known tags, the order matches the name table in LookupTag()
+  enum class TagId : uint8_t {
+    kUnknown,
+    kAnchor,
+    kBreak,
+    kCode,
+    kDiv,
+    kHead,
+    kLink,
+    kListItem,
+    kMeta,
+    kNav,
+    kNoScript,
+    kOption,
+    kOrderedList,
+    kParagraph,
+    kPre,
+    kScript,
+    kSpan,
+    kStyle,
+    kTemplate,
+    kTitle,
+    kUnorderedList,
+    kImg,
+    kSeperator,
+    kBold,
+    kStrong,
+    kItalic,
+    kItalic2,
+    kCitation,
+    kDefinition,
+    kUnderline,
+    kStrighthrought,
+    kStrighthrought2,
+    kBlockquote,
+    kHeader1,
+    kHeader2,
+    kHeader3,
+    kHeader4,
+    kHeader5,
+    kHeader6,
+    kTable,
+    kTableRow,
+    kTableHeader,
+    kTableData,
+
+    kCount
+  };
+
   size_t index_ch_in_html_ = 0;
 
   bool is_closing_tag_ = false;
@@ -388,209 +643,430 @@ private:
   bool is_in_table_row_ = false;
   bool is_in_tag_ = false;
   bool is_self_closing_tag_ = false;
+  // Whitespace right behind the '<' or a '/' in a tag is ignored
+  bool skipping_leading_whitespace_ = true;
 
   // relevant for <li> only, false = is in unordered list
   bool is_in_ordered_list_ = false;
-  uint8_t index_ol = 0;
+  size_t index_ol = 0;
+
+  // Kind and item number of the enclosing lists, restored when a nested list
+  // is closed. Grows with the nesting depth, there is no limit.
+  struct ListLevel {
+    bool is_ordered;
+    size_t index_ol;
+
+    bool operator==(const ListLevel &other) const {
+      return is_ordered == other.is_ordered && index_ol == other.index_ol;
+    }
+  };
+  std::vector<ListLevel> list_stack_;
 
   // store the table start
   size_t table_start = 0;
 
   // number of lists
-  uint8_t index_li = 0;
+  size_t index_li = 0;
 
-  uint8_t index_blockquote = 0;
+  size_t index_blockquote = 0;
 
   char prev_ch_in_md_ = 0, prev_prev_ch_in_md_ = 0;
   char prev_ch_in_html_ = 'x';
 
+  // Owned copy of the HTML, stays empty if the HTML is borrowed
   std::string html_;
+  // Borrowed HTML, nullptr if it is owned
+  const char *borrowed_html_ = nullptr;
+  size_t html_size_ = 0;
+
+  size_t offset_lt_ = 0;
+
+  // Set by feed(): the HTML arrives in chunks and the current tag is collected
+  // in tag_buffer_ instead of being read from html()
+  bool is_streaming_ = false;
+  std::string tag_buffer_;
+
+  // Character reference in the text, collected until its end is known. It can
+  // continue in the next chunk.
+  std::string reference_;
+  // Longest reference collected, longer ones are left as they are
+  static constexpr size_t kReferenceCapacity = 40;
+
+  TagId current_tag_ = TagId::kUnknown;
+  TagId prev_tag_ = TagId::kUnknown;
+
+  // Name of the current tag as written (lowercase), longer names are unknown
+  // anyway and only counted
+  static constexpr size_t kTagNameCapacity = 16;
+  char tag_name_[kTagNameCapacity] = {};
+  size_t tag_name_size_ = 0;
+  bool is_tag_name_complete_ = false;
+
+  // Last non-whitespace character of the tag, to detect attribute values
+  char last_ch_in_tag_ = 0;
+
+  // Name and value of an attribute, as offsets into TagBegin()
+  struct Attribute {
+    size_t name;
+    size_t name_size;
+    size_t value;
+    size_t value_size;
+  };
 
-  uint16_t offset_lt_ = 0;
-  std::string current_tag_;
-  std::string prev_tag_;
+  // Attributes of the current tag, valid if attributes_parsed_
+  std::vector<Attribute> attributes_;
+  bool attributes_parsed_ = false;
 
   // Line which separates header from data
   std::string tableLine;
 
+  // Used by formatTable, both are kept between tables to avoid allocations
+  TableFormatter table_formatter_;
+  std::string formatted_table_;
+  // Rows closed in the current table and whether the columns were measured
+  // already (see Options::tableSampleRows)
+  size_t table_rows_ = 0;
+  bool table_widths_fixed_ = false;
+
+  // Attributes of the anchor currently being converted
+  std::string current_href_;
+  std::string current_title_;
+
+  // Set by the anchor handlers: an anchor was opened, or one was closed that
+  // was opened before convertParallel() started the part
+  bool anchor_opened_ = false;
+  bool anchor_state_used_ = false;
+
   size_t chars_in_curr_line_ = 0;
 
   std::string md_;
 
+  // Set by setSink(), md_ is flushed once it reaches flush_at_
+  Sink *sink_ = nullptr;
+  size_t flush_threshold_ = 0;
+  size_t flush_at_ = SIZE_MAX;
+  std::string flush_buffer_;
+
+  // The cleanup runs as a stream over the Markdown, so it can also be applied
+  // part by part (see FlushMarkdown()). This is the state carried over.
+  static constexpr size_t kSequenceCount = 6;
+  struct CleanupState {
+    bool in_code_block = false;
+    uint8_t amount_newlines = 0;
+    bool has_output = false;
+    // Line breaks not passed to RewriteSequences() yet. They are sent in
+    // front of the next line, so both go through the stages in one piece.
+    size_t pending_newlines = 0;
+    // Possible start of each sequence replaced by RewriteSequences()
+    char partial[kSequenceCount][8] = {};
+    uint8_t partial_size[kSequenceCount] = {};
+
+    bool operator==(const CleanupState &other) const;
+  };
+  CleanupState cleanup_;
+  std::string cleanup_buffer_;
+  std::string cleanup_line_;
+
   Options option;
 
   std::unordered_map<std::string, std::string> htmlSymbolConversions_ = {
       {"&quot;", "\""}, {"&lt;", "<"},   {"&gt;", ">"},
       {"&amp;", "&"},   {"&nbsp;", " "}, {"&rarr;", "→"}};
 
+  // htmlSymbolConversions_ compiled into a trie, rebuilt by
+  // DecodeHtmlSymbols() after the map changed
+  struct SymbolNode {
+    char ch = 0;
+    uint32_t first_child = 0;  // 0: none, the root is never a child
+    uint32_t next_sibling = 0; // 0: none
+    int32_t replacement = -1;  // index into symbol_replacements_
+  };
+  std::vector<SymbolNode> symbol_trie_;
+  std::vector<std::string> symbol_replacements_;
+  // Bytes a symbol can start with
+  std::string symbol_first_bytes_;
+  bool symbol_trie_dirty_ = true;
+  // Cleared by clearHtmlSymbolConversions()
+  bool decode_character_references_ = true;
+
   // Tag: base class for tag types
   struct Tag {
-    virtual void OnHasLeftOpeningTag(Converter *c) = 0;
-    virtual void OnHasLeftClosingTag(Converter *c) = 0;
+    virtual void OnHasLeftOpeningTag(Converter *c) const = 0;
+    virtual void OnHasLeftClosingTag(Converter *c) const = 0;
   };
 
   // Tag types
 
   // tags that are not printed (nav, script, noscript, ...)
   struct TagIgnored : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override {};
-    void OnHasLeftClosingTag(Converter *c) override {};
+    void OnHasLeftOpeningTag(Converter *c) const override {};
+    void OnHasLeftClosingTag(Converter *c) const override {};
   };
 
   struct TagAnchor : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
-
-    std::string current_href_;
-    std::string current_title_;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagBold : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagItalic : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagUnderline : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagStrikethrought : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagBreak : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagDiv : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader1 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader2 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader3 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader4 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader5 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagHeader6 : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagListItem : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagOption : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagOrderedList : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagParagraph : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagPre : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagCode : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagSpan : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagTitle : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagUnorderedList : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagImage : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagSeperator : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagTable : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagTableRow : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagTableHeader : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagTableData : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
   };
 
   struct TagBlockquote : Tag {
-    void OnHasLeftOpeningTag(Converter *c) override;
-    void OnHasLeftClosingTag(Converter *c) override;
+    void OnHasLeftOpeningTag(Converter *c) const override;
+    void OnHasLeftClosingTag(Converter *c) const override;
+  };
+
+  // Map a lowercase tag name to its TagId (kUnknown for anything else)
+  // without allocating
+  static TagId LookupTag(const char *name, size_t size);
+
+  // Handler of a tag, nullptr for tags that are not converted (e.g. <link>).
+  // The handlers are immutable and shared by all instances and threads.
+  static const Tag *TagHandler(TagId id);
+
+  inline const char *html() const {
+    return borrowed_html_ ? borrowed_html_ : html_.data();
+  }
+
+  // Raw text of the current tag, from behind the '<' to the current character
+  inline const char *TagBegin() const {
+    return is_streaming_ ? tag_buffer_.data() : html() + offset_lt_;
+  }
+
+  inline size_t TagSize() const {
+    return is_streaming_ ? tag_buffer_.size() : index_ch_in_html_ - offset_lt_;
+  }
+
+  // Run the tokenizer over input, starting at index_ch_in_html_
+  void ParseHtml(const char *input, size_t size);
+
+  // The state of the parser that is carried from one tag to the next. The
+  // tag being parsed is not included, it's only valid outside of tags.
+  struct ParseState {
+    bool is_in_attribute_value;
+    bool is_in_code;
+    bool is_in_list;
+    bool is_in_p;
+    bool is_in_pre;
+    bool is_in_table;
+    bool is_in_table_row;
+    bool is_in_tag;
+    bool is_self_closing_tag;
+    bool is_in_ordered_list;
+    size_t index_ol;
+    size_t index_li;
+    size_t index_blockquote;
+    size_t chars_in_curr_line;
+    char prev_ch_in_md;
+    char prev_prev_ch_in_md;
+    TagId current_tag;
+    std::vector<ListLevel> list_stack;
+    std::string table_line;
+    std::string reference;
+    // Only used by a closing anchor, not compared by ==
+    std::string current_href;
+    std::string current_title;
+
+    bool operator==(const ParseState &other) const;
   };
 
-  std::unordered_map<std::string, std::shared_ptr<Tag>> tags_;
+  ParseState SaveParseState() const;
+  void RestoreParseState(const ParseState &state);
+
+  // Give worker the options, HTML symbol conversions and HTML of this instance
+  void PrepareWorker(Converter *worker) const;
 
-  explicit Converter(const std::string *html, struct Options *options);
+  // ParseHtml() over the whole HTML, split into `parts` converted at the same
+  // time
+  void ParseHtmlParallel(size_t parts);
+
+  // CleanUpMarkdown() split into `parts` cleaned up at the same time
+  void CleanUpMarkdownParallel(size_t parts);
+
+  // Lowest offset of md_ that was removed, changed or looked at further back
+  // than the last two characters since convertParallel() set it. Everything
+  // in front of it is still as it was.
+  size_t md_look_back_ = SIZE_MAX;
+
+  // Clean up md_ once all HTML has been parsed
+  void FinishMarkdown(size_t parts = 1);
 
   void CleanUpMarkdown();
 
+  /**
+   * Clean up Markdown in a single pass: trim lines, reduce empty lines, decode
+   * HTML symbols and replace sequences (like " , " by ", ").
+   *
+   * @param markdown  Markdown, complete lines unless last is set
+   * @param size      length of the Markdown
+   * @param last      also write what is held back as a possible start of a
+   *                  sequence
+   * @param out       cleaned up Markdown is appended here
+   */
+  void CleanUp(const char *markdown, size_t size, bool last, std::string *out);
+
+  // Line without its '\n'
+  void CleanUpLine(const char *line, size_t size, std::string *out);
+
+  // Output a non-empty line
+  void EmitLine(const char *line, size_t size, std::string *out);
+
+  void BuildSymbolTrie();
+
+  // Length of the longest symbol at pos, 0 if there is none
+  size_t MatchSymbol(const char *text, size_t size, size_t pos,
+                     int32_t *replacement) const;
+
+  // Replace the symbols of htmlSymbolConversions_, starting at offset `from`
+  void DecodeHtmlSymbols(const char *text, size_t size, size_t from,
+                         std::string *out);
+
+  // Stage `sequence` of the sequence replacements, each stage feeds the next
+  // one and the last one appends to out
+  void RewriteSequences(size_t sequence, const char *text, size_t size,
+                        std::string *out);
+
+  // Pass on the characters held back from stage `sequence` onwards
+  void FinishSequences(size_t sequence, std::string *out);
+
+  // Length of the part of md_ that can't change anymore, 0 if there is none
+  [[nodiscard]] size_t FlushableMarkdown() const;
+
+  // Clean up the finished part of md_ and write it to sink_
+  void FlushMarkdown();
+
   // Trim from start (in place)
   static void LTrim(std::string *s);
 
@@ -600,14 +1076,27 @@ private:
   // Trim from both ends (in place)
   Converter *Trim(std::string *s);
 
-  // 1. trim all lines
-  // 2. reduce consecutive newlines to maximum 3
-  void TidyAllLines(std::string *str);
+  // Value of an attribute of the current tag, points into the tag
+  struct AttributeValue {
+    const char *data;
+    size_t size;
+  };
 
-  std::string ExtractAttributeFromTagLeftOf(const std::string &attr);
+  // Looks up an attribute of the current tag by its lowercase name, whole
+  // names only. The value is empty if the attribute is missing.
+  AttributeValue ExtractAttribute(const char *name);
+
+  // Splits the current tag into attributes_, done once per tag on the first
+  // lookup
+  void ParseAttributes();
 
   void TurnLineIntoHeader1();
 
+  // Save the kind and numbering of the current list and start a nested one
+  void EnterList(bool ordered);
+  // Continue the list around the one that was closed
+  void LeaveList();
+
   void TurnLineIntoHeader2();
 
   // Current char: '<'
@@ -626,17 +1115,25 @@ private:
   // Current char: '>'
   bool OnHasLeftTag();
 
-  inline static bool TagContainsAttributesToHide(std::string *tag) {
-    using std::string;
+  // Checks the tag left of the current offset for attributes (like
+  // `display:none`) that hide it
+  [[nodiscard]] bool TagContainsAttributesToHide() const;
+
+  Converter *ShortenMarkdown(size_t chars = 1);
+
+  // Replace the table since table_start by its formatted version. Before the
+  // table is closed, only once Options::tableSampleRows rows are there.
+  void FormatTable(bool table_closed);
+
+  // Position in md_ to return to with RollbackTo(). FlushMarkdown() moves the
+  // start of md_, so it has to adjust stored marks (like table_start).
+  inline size_t Mark() const { return md_.size(); }
 
-    return (*tag).find(" aria=\"hidden\"") != string::npos ||
-           (*tag).find("display:none") != string::npos ||
-           (*tag).find("visibility:hidden") != string::npos ||
-           (*tag).find("opacity:0") != string::npos ||
-           (*tag).find("Details-content--hidden-not-important") != string::npos;
+  // Drop everything appended since mark, O(1)
+  inline Converter *RollbackTo(size_t mark) {
+    return ShortenMarkdown(md_.size() - mark);
   }
 
-  Converter *ShortenMarkdown(size_t chars = 1);
   inline bool shortIfPrevCh(char prev) {
     if (prev_ch_in_md_ == prev) {
       ShortenMarkdown();
@@ -651,12 +1148,33 @@ private:
    */
   bool ParseCharInTagContent(char ch);
 
+  /**
+   * Append a run of plain text in one go.
+   *
+   * @param text   text without structural characters (see StructuralIndex)
+   * @param length length of the text
+   * @return       number of characters consumed, the rest has to go through
+   *               ParseCharInTagContent()
+   */
+  size_t AppendTextRun(const char *text, size_t length);
+
+  // Add ch to reference_, false if ch isn't part of the reference
+  bool ContinueReference(char ch);
+
+  // Decode reference_ and append it to md_, `next` is the character after it
+  // (0 if there is none)
+  void FlushReference(char next);
+
+  // Append decoded text, characters that are Markdown syntax are escaped
+  void AppendDecodedText(const char *text, size_t size);
+
   // Replace previous space (if any) in current markdown line by newline
   bool ReplacePreviousSpaceInLineByNewline();
 
-  static inline bool IsIgnoredTag(const std::string &tag) {
-    return (tag[0] == '-' || kTagTemplate == tag || kTagStyle == tag ||
-            kTagScript == tag || kTagNoScript == tag || kTagNav == tag);
+  static inline bool IsIgnoredTag(TagId tag) {
+    return tag == TagId::kTemplate || tag == TagId::kStyle ||
+           tag == TagId::kScript || tag == TagId::kNoScript ||
+           tag == TagId::kNav;
 
     // meta: not ignored to tolerate if closing is omitted
   }
@@ -669,14 +1187,12 @@ private:
  * \param html The HTML passed to Converter
  * \param ok Optional: Pass a reference to a local bool to store the output of
  * Converter::ok() \return Returns the by Converter generated Markdown
+ *
+ * Every thread keeps one Converter with default options around and reuses its
+ * buffers, so calling this repeatedly doesn't allocate a new Converter each
+ * time. Safe to call from several threads at once.
  */
-inline std::string Convert(const std::string &html, bool *ok = nullptr) {
-  Converter c(html);
-  auto md = c.convert();
-  if (ok != nullptr)
-    *ok = c.ok();
-  return md;
-}
+std::string Convert(const std::string &html, bool *ok = nullptr);
 
 #ifndef PYTHON_BINDINGS
 inline std::string Convert(const std::string &&html, bool *ok = nullptr) {
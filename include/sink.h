@@ -0,0 +1,119 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef SINK_H
+#define SINK_H
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <utility>
+
+namespace html2md {
+
+/*!
+ * \brief Receives the generated Markdown part by part
+ *
+ * Pass a sink to Converter::setSink() to get the Markdown while it is being
+ * generated instead of in one piece at the end. Only parts that can't change
+ * anymore are written, in order; concatenated they are exactly what
+ * Converter::convert() would have returned.
+ *
+ * Implement write() for other targets.
+ */
+class Sink {
+public:
+  virtual ~Sink() = default;
+
+  /*!
+   * \brief Called with the next part of the Markdown
+   * \param data The Markdown, not null-terminated.
+   * \param size Length of the part in bytes.
+   */
+  virtual void write(const char *data, size_t size) = 0;
+};
+
+/*!
+ * \brief Hands every part to a function
+ */
+class CallbackSink : public Sink {
+public:
+  using Callback = std::function<void(const char *data, size_t size)>;
+
+  explicit CallbackSink(Callback callback) : callback_(std::move(callback)) {}
+
+  void write(const char *data, size_t size) override {
+    callback_(data, size);
+  }
+
+private:
+  Callback callback_;
+};
+
+/*!
+ * \brief Writes to a std::ostream, e.g. std::cout or a std::ofstream
+ */
+class OstreamSink : public Sink {
+public:
+  explicit OstreamSink(std::ostream &stream) : stream_(stream) {}
+
+  void write(const char *data, size_t size) override;
+
+private:
+  std::ostream &stream_;
+};
+
+/*!
+ * \brief Writes to a file descriptor (a file, pipe or socket)
+ *
+ * The file descriptor is not closed.
+ */
+class FdSink : public Sink {
+public:
+  explicit FdSink(int fd) : fd_(fd) {}
+
+  void write(const char *data, size_t size) override;
+
+  /*!
+   * \brief Returns false if a write failed, the rest is dropped after that.
+   */
+  [[nodiscard]] bool ok() const { return ok_; }
+
+private:
+  int fd_;
+  bool ok_ = true;
+};
+
+/*!
+ * \brief Fills a fixed buffer owned by the caller
+ *
+ * Nothing is allocated. Markdown that doesn't fit anymore is dropped and
+ * overflowed() returns true.
+ */
+class BufferSink : public Sink {
+public:
+  BufferSink(char *buffer, size_t capacity)
+      : buffer_(buffer), capacity_(capacity) {}
+
+  void write(const char *data, size_t size) override;
+
+  /*!
+   * \brief Number of bytes written into the buffer
+   */
+  [[nodiscard]] size_t size() const { return size_; }
+
+  /*!
+   * \brief Returns true if the Markdown didn't fit into the buffer
+   */
+  [[nodiscard]] bool overflowed() const { return overflowed_; }
+
+private:
+  char *buffer_;
+  size_t capacity_;
+  size_t size_ = 0;
+  bool overflowed_ = false;
+};
+
+} // namespace html2md
+
+#endif // SINK_H
@@ -4,7 +4,70 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include <cstddef>
 #include <string>
+#include <vector>
+
+namespace html2md {
+
+/*!
+ * \brief Pads the cells of a Markdown table so the columns line up
+ *
+ * The table is split into cells without copying them: only the offset and
+ * length of every cell is recorded. The buffers are kept between calls, so
+ * an instance that formats many tables stops allocating once it has seen the
+ * largest one.
+ *
+ * Huge tables can be formatted in parts: format() the first rows to measure
+ * the columns, then pass the rest to formatRows() as it arrives.
+ */
+class TableFormatter {
+public:
+  /*!
+   * \brief Format a table and append it to `out`
+   * \param table The table, one row per line, cells separated by `|`
+   * \param size Length of the table
+   * \param out The formatted table is appended to it
+   *
+   * The second row is turned into the separator row. Empty rows and cells are
+   * dropped. An escaped `\|` doesn't end a cell, and widths are counted in
+   * characters rather than bytes.
+   */
+  void format(const char *table, size_t size, std::string *out);
+
+  /*!
+   * \brief Format more rows of the table passed to format()
+   * \param rows The rows, one per line, cells separated by `|`
+   * \param size Length of the rows
+   * \param out The formatted rows are appended to it
+   *
+   * The columns keep the widths measured by format(). A longer cell is written
+   * in full, so the row is still valid but not aligned.
+   */
+  void formatRows(const char *rows, size_t size, std::string *out);
+
+private:
+  struct Cell {
+    size_t offset;
+    size_t size;
+    size_t width; // In characters
+  };
+
+  void Split(const char *table, size_t size, bool measure);
+  void AddRow(const char *table, size_t begin, size_t end, bool measure);
+  void WriteRows(const char *table, std::string *out);
+  void AppendSeparator(const char *cell, size_t cell_size, size_t width,
+                       std::string *out) const;
+
+  std::vector<Cell> cells_;
+  // For every row, the index in cells_ after its last cell
+  std::vector<size_t> row_ends_;
+  std::vector<size_t> widths_;
+  // Rows written since the last format(), the second one is the separator
+  size_t rows_written_ = 0;
+};
+
+} // namespace html2md
 
 [[nodiscard]] std::string formatMarkdownTable(const std::string &inputTable);
 
@@ -24,6 +24,9 @@ PYBIND11_MODULE(pyhtml2md, m) {
                      "beginning of the markdown")
       .def_readwrite("formatTable", &html2md::Options::formatTable,
                      "Whether to format Markdown Tables")
+      .def_readwrite("tableSampleRows", &html2md::Options::tableSampleRows,
+                     "Measure formatted tables on their first ... rows and "
+                     "stream the rest (0 measures the whole table)")
       .def_readwrite("forceLeftTrim", &html2md::Options::forceLeftTrim,
                      "Whether to force left trim")
       .def_readwrite("compressWhitespace", &html2md::Options::compressWhitespace,
@@ -39,8 +42,16 @@ PYBIND11_MODULE(pyhtml2md, m) {
       .def(py::init<std::string &, html2md::Options *>(),
            "Class for converting HTML to Markdown", py::arg("html"),
            py::arg("options") = py::none())
-      .def("convert", &html2md::Converter::convert,
+      .def("convert",
+           static_cast<std::string (html2md::Converter::*)()>(
+               &html2md::Converter::convert),
            "This function actually converts the HTML into Markdown.")
+      .def("convert",
+           static_cast<std::string (html2md::Converter::*)(
+               const std::string &)>(&html2md::Converter::convert),
+           "Convert another HTML document, reusing the buffers of this "
+           "instance",
+           py::arg("html"))
       .def("ok", &html2md::Converter::ok,
            "Checks if everything was closed properly(in the HTML).")
       .def("add_html_symbol_conversion",
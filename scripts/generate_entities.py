@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# Copyright (c) Tim Gromeyer
+# Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+"""Generate src/html_entities.h from the WHATWG named character references.
+
+The list is the one shipped with Python (html.entities.html5), which is taken
+from https://html.spec.whatwg.org/entities.json.
+
+Usage: python3 scripts/generate_entities.py > src/html_entities.h
+"""
+
+from html.entities import html5
+
+
+def c_string(data):
+    out = ""
+    for byte in data:
+        ch = chr(byte)
+        if ch.isascii() and (ch.isalnum() or ch == ";"):
+            out += ch
+        else:
+            out += "\\%03o" % byte
+    return out
+
+
+def c_literal(data, indent="    ", width=72):
+    lines = []
+    line = ""
+    for i in range(len(data)):
+        piece = c_string(data[i:i + 1])
+        if len(line) + len(piece) > width:
+            lines.append(indent + '"' + line + '"')
+            line = ""
+        line += piece
+    lines.append(indent + '"' + line + '"')
+    return "\n".join(lines)
+
+
+def main():
+    names = sorted(html5, key=lambda name: name.encode())
+
+    name_blob = b""
+    value_blob = b""
+    values = {}
+    entries = []
+
+    for name in names:
+        encoded_name = name.encode()
+        value = html5[name].encode()
+
+        if value not in values:
+            values[value] = len(value_blob)
+            value_blob += value
+
+        entries.append((len(name_blob), values[value], len(encoded_name),
+                        len(value)))
+        name_blob += encoded_name
+
+    assert len(name_blob) < 1 << 16 and len(value_blob) < 1 << 16
+
+    print("""// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// Generated by scripts/generate_entities.py, do not edit.
+
+#ifndef HTML_ENTITIES_H
+#define HTML_ENTITIES_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace html2md {
+namespace entities {
+
+// A named character reference without the leading '&'. Names that end
+// without ';' are the legacy ones browsers also accept without it.
+struct Entity {
+  uint16_t name;  // offset into kNames
+  uint16_t value; // offset into kValues, UTF-8
+  uint8_t name_size;
+  uint8_t value_size;
+};
+""")
+    print("constexpr char kNames[] =\n%s;\n" % c_literal(name_blob))
+    print("constexpr char kValues[] =\n%s;\n" % c_literal(value_blob))
+    print("constexpr size_t kLongestName = %d;\n" %
+          max(len(name) for name in names))
+    print("// Sorted by name (byte-wise)")
+    print("constexpr Entity kEntities[] = {")
+    for entry in entries:
+        print("    {%d, %d, %d, %d}," % entry)
+    print("""};
+
+} // namespace entities
+} // namespace html2md
+
+#endif // HTML_ENTITIES_H""")
+
+
+if __name__ == "__main__":
+    main()
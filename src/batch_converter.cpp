@@ -0,0 +1,236 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "batch_converter.h"
+
+#include <exception>
+#include <utility>
+
+using std::string;
+
+namespace html2md {
+
+// State shared by the tasks of one submit() or convert() call
+struct BatchConverter::Batch {
+  const string *inputs = nullptr;
+  size_t count = 0;
+
+  // submit(): one promise per input
+  std::vector<std::promise<string>> promises;
+
+  // convert(): results that wait for their predecessors
+  const Callback *callback = nullptr;
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::vector<string> results;
+  std::vector<bool> ready;
+  std::vector<bool> failed;
+  size_t next = 0;         // Next index to pass to the callback
+  bool delivering = false; // A worker is calling the callback
+  std::exception_ptr error;
+};
+
+BatchConverter::BatchConverter(unsigned threads, Options options)
+    : options_(options) {
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads == 0)
+    threads = 1;
+
+  for (unsigned i = 0; i < threads; ++i)
+    queues_.emplace_back(new WorkQueue);
+
+  for (unsigned i = 0; i < threads; ++i)
+    workers_.emplace_back(&BatchConverter::Work, this, i);
+}
+
+BatchConverter::~BatchConverter() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+std::vector<std::future<string>>
+BatchConverter::submit(const string *inputs, size_t count) {
+  std::vector<std::future<string>> futures;
+  if (count == 0)
+    return futures;
+
+  auto batch = std::make_shared<Batch>();
+  batch->inputs = inputs;
+  batch->count = count;
+  batch->promises.resize(count);
+
+  futures.reserve(count);
+  for (auto &promise : batch->promises)
+    futures.push_back(promise.get_future());
+
+  Enqueue(batch);
+  return futures;
+}
+
+void BatchConverter::convert(const string *inputs, size_t count,
+                             const Callback &callback) {
+  if (count == 0)
+    return;
+
+  auto batch = std::make_shared<Batch>();
+  batch->inputs = inputs;
+  batch->count = count;
+  batch->callback = &callback;
+  batch->results.resize(count);
+  batch->ready.resize(count, false);
+  batch->failed.resize(count, false);
+
+  Enqueue(batch);
+
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->finished.wait(
+      lock, [&] { return batch->next == count && !batch->delivering; });
+
+  if (batch->error)
+    std::rethrow_exception(batch->error);
+}
+
+std::vector<string>
+BatchConverter::convert(const std::vector<string> &inputs) {
+  std::vector<string> md(inputs.size());
+  convert(inputs.data(), inputs.size(), [&](size_t index, string &&result) {
+    md[index] = std::move(result);
+  });
+  return md;
+}
+
+void BatchConverter::Enqueue(const std::shared_ptr<Batch> &batch) {
+  // Counted first, so a worker never takes a task that isn't counted yet
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    queued_ += batch->count;
+  }
+
+  // Round-robin, so every worker starts near the beginning of the batch
+  size_t first = next_queue_.fetch_add(batch->count);
+  for (size_t i = 0; i < batch->count; ++i) {
+    WorkQueue &queue = *queues_[(first + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back({batch, i});
+  }
+
+  wake_.notify_all();
+}
+
+bool BatchConverter::TakeTask(size_t worker, Task *task) {
+  {
+    WorkQueue &own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    WorkQueue &other = *queues_[(worker + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      *task = std::move(other.tasks.back());
+      other.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void BatchConverter::Work(size_t worker) {
+  Converter converter(&options_);
+  Task task;
+
+  for (;;) {
+    if (TakeTask(worker, &task)) {
+      Run(&converter, task);
+      task.batch.reset();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.wait(lock, [this] { return queued_ != 0 || stopping_; });
+    if (queued_ == 0 && stopping_)
+      return;
+  }
+}
+
+void BatchConverter::Run(Converter *converter, const Task &task) {
+  Batch &batch = *task.batch;
+  const string &html = batch.inputs[task.index];
+
+  string md;
+  std::exception_ptr error;
+  try {
+    converter->reset(html.data(), html.size());
+    md = converter->convert();
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  if (!batch.callback) {
+    if (error)
+      batch.promises[task.index].set_exception(error);
+    else
+      batch.promises[task.index].set_value(std::move(md));
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  batch.results[task.index] = std::move(md);
+  batch.ready[task.index] = true;
+  if (error) {
+    batch.failed[task.index] = true;
+    if (!batch.error)
+      batch.error = error;
+  }
+
+  // Only one worker calls the callback, the others leave their result behind
+  // for it
+  if (batch.delivering)
+    return;
+  batch.delivering = true;
+
+  // next only moves on once the callback returned, so convert() can't return
+  // (and destroy the callback) while it still runs
+  while (batch.next < batch.count && batch.ready[batch.next]) {
+    size_t index = batch.next;
+
+    if (!batch.failed[index]) {
+      string result = std::move(batch.results[index]);
+
+      lock.unlock();
+      std::exception_ptr callback_error;
+      try {
+        (*batch.callback)(index, std::move(result));
+      } catch (...) {
+        callback_error = std::current_exception();
+      }
+      lock.lock();
+
+      if (callback_error && !batch.error)
+        batch.error = callback_error;
+    }
+
+    ++batch.next;
+  }
+
+  batch.delivering = false;
+  if (batch.next == batch.count)
+    batch.finished.notify_all();
+}
+
+} // namespace html2md
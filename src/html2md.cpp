@@ -2,16 +2,16 @@
 // Licensed under the MIT License - https://opensource.org/licenses/MIT
 
 #include "html2md.h"
+#include "html_entities.h"
+#include "structural_index.h"
 #include "table.h"
 
 #include <algorithm>
 #include <cctype>
 #include <cstring>
-#include <memory>
 #include <sstream>
 #include <vector>
 
-using std::make_shared;
 using std::string;
 using std::vector;
 
@@ -26,30 +26,23 @@ bool endsWith(const string &str, const string &suffix) {
          0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
 }
 
-size_t ReplaceAll(string *haystack, const string &needle,
-                  const string &replacement) {
-  // Get first occurrence
-  size_t pos = (*haystack).find(needle);
+// Fix-ups of the cleanup, applied one after another (see
+// Converter::RewriteSequences())
+struct Sequence {
+  const char *from;
+  size_t from_size;
+  const char *to;
+  size_t to_size;
+};
 
-  size_t amount_replaced = 0;
+constexpr Sequence kSequences[] = {
+    {" , ", 3, ", ", 2},       {"\n.\n", 3, ".\n", 2},
+    {"\n↵\n", 5, " ↵\n", 5}, {"\n*\n", 3, "\n", 1},
+    {"\n. ", 3, ".\n", 2},     {"\t\t  ", 4, "\t\t", 2},
+};
 
-  // Repeat until end is reached
-  while (pos != string::npos) {
-    // Replace this occurrence of sub string
-    (*haystack).replace(pos, needle.size(), replacement);
-
-    // Get the next occurrence from the current position
-    pos = (*haystack).find(needle, pos + replacement.size());
-
-    ++amount_replaced;
-  }
-
-  return amount_replaced;
-}
-
-size_t ReplaceAll(string *haystack, const string &needle, const char c) {
-  return ReplaceAll(haystack, needle, string({c}));
-}
+static_assert(sizeof(kSequences) / sizeof(kSequences[0]) == 6,
+              "update Converter::kSequenceCount");
 
 // Split given string by given character delimiter into vector of strings
 vector<string> Split(string const &str, char delimiter) {
@@ -81,133 +74,756 @@ string Repeat(const string &str, size_t amount) {
   return out;
 }
 
-string toLower(const string &str) {
-  string lower;
-  lower.reserve(str.size());
-  for (char ch : str) {
-    lower += tolower(ch);
+// Case-insensitive search for a lowercase needle
+bool ContainsIgnoreCase(const char *haystack, size_t size, const char *needle) {
+  size_t needle_size = strlen(needle);
+
+  for (size_t i = 0; i + needle_size <= size; ++i) {
+    size_t j = 0;
+    while (j < needle_size &&
+           tolower(static_cast<unsigned char>(haystack[i + j])) == needle[j])
+      ++j;
+
+    if (j == needle_size)
+      return true;
+  }
+
+  return false;
+}
+
+// Perfect hash over the known tag names, see Converter::LookupTag()
+constexpr size_t kTagSlots = 128;
+
+constexpr size_t TagHash(const char *name, size_t size) {
+  return (static_cast<unsigned char>(name[0]) +
+          (size > 1 ? static_cast<unsigned char>(name[1]) * 51 : 0) +
+          static_cast<unsigned char>(name[size - 1]) * 6 + size) &
+         (kTagSlots - 1);
+}
+
+constexpr size_t ConstLength(const char *str) {
+  return *str == '\0' ? 0 : 1 + ConstLength(str + 1);
+}
+
+// Every name has to hash to the slot holding its own index, which also means
+// that no two names share a slot
+constexpr bool IsPerfectHash(const char *const *names, const uint8_t *slots,
+                             size_t i, size_t count) {
+  return i == count ||
+         (slots[TagHash(names[i], ConstLength(names[i]))] == i &&
+          IsPerfectHash(names, slots, i + 1, count));
+}
+
+// Named character references, see html_entities.h
+int CompareEntityName(const html2md::entities::Entity &entity, const char *name,
+                      size_t size) {
+  int result = memcmp(html2md::entities::kNames + entity.name, name,
+                      std::min<size_t>(entity.name_size, size));
+  if (result != 0)
+    return result;
+
+  return entity.name_size < size ? -1 : entity.name_size > size;
+}
+
+const html2md::entities::Entity *FindEntity(const char *name, size_t size) {
+  using html2md::entities::Entity;
+  using html2md::entities::kEntities;
+
+  const Entity *end = kEntities + sizeof(kEntities) / sizeof(kEntities[0]);
+  const Entity *found = std::lower_bound(
+      kEntities, end, 0, [name, size](const Entity &entity, int) {
+        return CompareEntityName(entity, name, size) < 0;
+      });
+
+  if (found == end || CompareEntityName(*found, name, size) != 0)
+    return nullptr;
+
+  return found;
+}
+
+// Code point of a numeric character reference as browsers interpret it
+uint32_t FixCodePoint(uint32_t code_point) {
+  // Windows-1252 for 0x80 - 0x9F, 0 where it has no character
+  static constexpr uint16_t kWindows1252[32] = {
+      0x20AC, 0,      0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+      0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0,      0x017D, 0,
+      0,      0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+      0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0,      0x017E, 0x0178};
+
+  if (code_point == 0 || code_point > 0x10FFFF ||
+      (code_point >= 0xD800 && code_point <= 0xDFFF))
+    return 0xFFFD;
+
+  if (code_point >= 0x80 && code_point <= 0x9F &&
+      kWindows1252[code_point - 0x80] != 0)
+    return kWindows1252[code_point - 0x80];
+
+  return code_point;
+}
+
+// Returns the length of the UTF-8 sequence written to out (at most 4)
+size_t EncodeUtf8(uint32_t code_point, char *out) {
+  if (code_point < 0x80) {
+    out[0] = static_cast<char>(code_point);
+    return 1;
   }
-  return lower;
+
+  if (code_point < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (code_point >> 6));
+    out[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+    return 2;
+  }
+
+  if (code_point < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (code_point >> 12));
+    out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+    return 3;
+  }
+
+  out[0] = static_cast<char>(0xF0 | (code_point >> 18));
+  out[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+  return 4;
+}
+
+/**
+ * Decode the character reference (`&name;`, `&#123;` or `&#x7B;`) at pos.
+ *
+ * @param text        text, text[pos] is '&'
+ * @param size        length of the text
+ * @param pos         offset of the '&'
+ * @param buffer      room for a numeric reference's UTF-8, at least 4 bytes
+ * @param value       set to the decoded UTF-8
+ * @param value_size  set to the length of value
+ * @return            length of the reference, 0 if there is none
+ */
+size_t DecodeCharacterReference(const char *text, size_t size, size_t pos,
+                                char *buffer, const char **value,
+                                size_t *value_size) {
+  size_t i = pos + 1;
+
+  if (i < size && text[i] == '#') {
+    bool hex = ++i < size && (text[i] == 'x' || text[i] == 'X');
+    if (hex)
+      ++i;
+
+    size_t digits_start = i;
+    uint32_t code_point = 0;
+
+    for (; i < size; ++i) {
+      auto ch = static_cast<unsigned char>(text[i]);
+      uint32_t digit;
+
+      if (isdigit(ch))
+        digit = ch - '0';
+      else if (hex && isxdigit(ch))
+        digit = (tolower(ch) - 'a') + 10;
+      else
+        break;
+
+      // Saturate, anything too large becomes U+FFFD anyway
+      code_point = std::min<uint32_t>(code_point * (hex ? 16 : 10) + digit,
+                                      0x110000);
+    }
+
+    if (i == digits_start)
+      return 0;
+
+    if (i < size && text[i] == ';')
+      ++i;
+
+    *value = buffer;
+    *value_size = EncodeUtf8(FixCodePoint(code_point), buffer);
+    return i - pos;
+  }
+
+  size_t name_start = i;
+  while (i < size && i - name_start < html2md::entities::kLongestName &&
+         isalnum(static_cast<unsigned char>(text[i])))
+    ++i;
+
+  if (i == name_start || i - name_start >= html2md::entities::kLongestName)
+    return 0;
+
+  // Names without ';' are only legacy ones, and like in attribute values they
+  // are kept if a '=' follows (`?a=1&copy=2`)
+  if (i < size && text[i] == ';')
+    ++i;
+  else if (i < size && text[i] == '=')
+    return 0;
+
+  const auto *entity = FindEntity(text + name_start, i - name_start);
+  if (!entity)
+    return 0;
+
+  *value = html2md::entities::kValues + entity->value;
+  *value_size = entity->value_size;
+  return i - pos;
 }
 
 } // namespace
 
 namespace html2md {
 
-Converter::Converter(const string *html, Options *options) : html_(*html) {
+Converter::Converter(const string &html, Options *options)
+    : Converter(options) {
+  html_ = html;
+  html_size_ = html_.size();
+  md_.reserve(html_size_ * 1.2);
+}
+
+Converter::Converter(string &&html, Options *options) : Converter(options) {
+  html_ = std::move(html);
+  html_size_ = html_.size();
+  md_.reserve(html_size_ * 1.2);
+}
+
+Converter::Converter(const char *html, Options *options)
+    : Converter(string(html), options) {}
+
+Converter::Converter(const char *html, size_t size, Options *options)
+    : Converter(options) {
+  borrowed_html_ = html;
+  html_size_ = size;
+  md_.reserve(html_size_ * 1.2);
+}
+
+Converter::Converter(Options *options) {
   if (options)
     option = *options;
+}
 
-  md_.reserve(html->size() * 1.2);
-  tags_.reserve(41);
+Converter::TagId Converter::LookupTag(const char *name, size_t size) {
+  // Indexed by TagId
+  static constexpr const char *kNames[] = {
+      "",
+      kTagAnchor,
+      kTagBreak,
+      kTagCode,
+      kTagDiv,
+      kTagHead,
+      kTagLink,
+      kTagListItem,
+      kTagMeta,
+      kTagNav,
+      kTagNoScript,
+      kTagOption,
+      kTagOrderedList,
+      kTagParagraph,
+      kTagPre,
+      kTagScript,
+      kTagSpan,
+      kTagStyle,
+      kTagTemplate,
+      kTagTitle,
+      kTagUnorderedList,
+      kTagImg,
+      kTagSeperator,
+      kTagBold,
+      kTagStrong,
+      kTagItalic,
+      kTagItalic2,
+      kTagCitation,
+      kTagDefinition,
+      kTagUnderline,
+      kTagStrighthrought,
+      kTagStrighthrought2,
+      kTagBlockquote,
+      kTagHeader1,
+      kTagHeader2,
+      kTagHeader3,
+      kTagHeader4,
+      kTagHeader5,
+      kTagHeader6,
+      kTagTable,
+      kTagTableRow,
+      kTagTableHeader,
+      kTagTableData,
+  };
+
+  // Maps TagHash() to TagId, generated from kNames
+  static constexpr uint8_t kSlots[kTagSlots] = {
+       0,  0,  0, 20,  0,  0,  0, 14,  9,  0,  0,  0, 34, 21, 30,  0,
+       0, 13,  0,  0,  0,  0,  4,  0,  0,  0,  0,  0,  0,  0, 41,  0,
+       0,  0,  0,  0,  0,  0, 31,  0,  1,  0, 39,  0, 25,  0,  0, 23,
+      27,  0,  0,  0, 29,  0,  0, 37,  0,  0, 42,  0,  0,  0,  0,  0,
+       0,  0, 19,  0,  0, 35,  2,  0,  0,  0,  0, 10, 22, 28, 32,  7,
+       0,  0,  0, 33,  0,  0,  8,  0, 40, 11,  0, 16,  0,  6,  0,  0,
+      26,  0,  3,  5,  0,  0,  0,  0,  0,  0, 15,  0,  0,  0,  0,  0,
+      38,  0, 17,  0,  0,  0,  0,  0,  0, 18,  0,  0,  0, 12, 36, 24,
+  };
+
+  static_assert(sizeof(kNames) / sizeof(kNames[0]) ==
+                    static_cast<size_t>(TagId::kCount),
+                "kNames doesn't match TagId");
+  static_assert(IsPerfectHash(kNames, kSlots, 1,
+                              static_cast<size_t>(TagId::kCount)),
+                "TagHash() is not perfect for kNames, regenerate kSlots");
+
+  if (size == 0)
+    return TagId::kUnknown;
+
+  uint8_t id = kSlots[TagHash(name, size)];
+  const char *known = kNames[id];
 
+  if (id == 0 || strlen(known) != size || memcmp(known, name, size) != 0)
+    return TagId::kUnknown;
+
+  return static_cast<TagId>(id);
+}
+
+const Converter::Tag *Converter::TagHandler(TagId id) {
   // non-printing tags
-  auto tagIgnored = make_shared<Converter::TagIgnored>();
-  tags_[kTagHead] = tagIgnored;
-  tags_[kTagMeta] = tagIgnored;
-  tags_[kTagNav] = tagIgnored;
-  tags_[kTagNoScript] = tagIgnored;
-  tags_[kTagScript] = tagIgnored;
-  tags_[kTagStyle] = tagIgnored;
-  tags_[kTagTemplate] = tagIgnored;
+  static const TagIgnored tagIgnored{};
 
   // printing tags
-  tags_[kTagAnchor] = make_shared<Converter::TagAnchor>();
-  tags_[kTagBreak] = make_shared<Converter::TagBreak>();
-  tags_[kTagDiv] = make_shared<Converter::TagDiv>();
-  tags_[kTagHeader1] = make_shared<Converter::TagHeader1>();
-  tags_[kTagHeader2] = make_shared<Converter::TagHeader2>();
-  tags_[kTagHeader3] = make_shared<Converter::TagHeader3>();
-  tags_[kTagHeader4] = make_shared<Converter::TagHeader4>();
-  tags_[kTagHeader5] = make_shared<Converter::TagHeader5>();
-  tags_[kTagHeader6] = make_shared<Converter::TagHeader6>();
-  tags_[kTagListItem] = make_shared<Converter::TagListItem>();
-  tags_[kTagOption] = make_shared<Converter::TagOption>();
-  tags_[kTagOrderedList] = make_shared<Converter::TagOrderedList>();
-  tags_[kTagPre] = make_shared<Converter::TagPre>();
-  tags_[kTagCode] = make_shared<Converter::TagCode>();
-  tags_[kTagParagraph] = make_shared<Converter::TagParagraph>();
-  tags_[kTagSpan] = make_shared<Converter::TagSpan>();
-  tags_[kTagUnorderedList] = make_shared<Converter::TagUnorderedList>();
-  tags_[kTagTitle] = make_shared<Converter::TagTitle>();
-  tags_[kTagImg] = make_shared<Converter::TagImage>();
-  tags_[kTagSeperator] = make_shared<Converter::TagSeperator>();
+  static const TagAnchor tagAnchor{};
+  static const TagBreak tagBreak{};
+  static const TagDiv tagDiv{};
+  static const TagHeader1 tagHeader1{};
+  static const TagHeader2 tagHeader2{};
+  static const TagHeader3 tagHeader3{};
+  static const TagHeader4 tagHeader4{};
+  static const TagHeader5 tagHeader5{};
+  static const TagHeader6 tagHeader6{};
+  static const TagListItem tagListItem{};
+  static const TagOption tagOption{};
+  static const TagOrderedList tagOrderedList{};
+  static const TagPre tagPre{};
+  static const TagCode tagCode{};
+  static const TagParagraph tagParagraph{};
+  static const TagSpan tagSpan{};
+  static const TagUnorderedList tagUnorderedList{};
+  static const TagTitle tagTitle{};
+  static const TagImage tagImage{};
+  static const TagSeperator tagSeperator{};
 
   // Text formatting
-  auto tagBold = make_shared<Converter::TagBold>();
-  tags_[kTagBold] = tagBold;
-  tags_[kTagStrong] = tagBold;
+  static const TagBold tagBold{};
+  static const TagItalic tagItalic{};
+  static const TagUnderline tagUnderline{};
+  static const TagStrikethrought tagStrighthrought{};
 
-  auto tagItalic = make_shared<Converter::TagItalic>();
-  tags_[kTagItalic] = tagItalic;
-  tags_[kTagItalic2] = tagItalic;
-  tags_[kTagDefinition] = tagItalic;
-  tags_[kTagCitation] = tagItalic;
+  static const TagBlockquote tagBlockquote{};
 
-  tags_[kTagUnderline] = make_shared<Converter::TagUnderline>();
-
-  auto tagStrighthrought = make_shared<Converter::TagStrikethrought>();
-  tags_[kTagStrighthrought] = tagStrighthrought;
-  tags_[kTagStrighthrought2] = tagStrighthrought;
+  // Tables
+  static const TagTable tagTable{};
+  static const TagTableRow tagTableRow{};
+  static const TagTableHeader tagTableHeader{};
+  static const TagTableData tagTableData{};
+
+  // Indexed by TagId
+  static const Tag *const handlers[] = {
+      nullptr,
+      &tagAnchor,
+      &tagBreak,
+      &tagCode,
+      &tagDiv,
+      &tagIgnored,
+      nullptr,
+      &tagListItem,
+      &tagIgnored,
+      &tagIgnored,
+      &tagIgnored,
+      &tagOption,
+      &tagOrderedList,
+      &tagParagraph,
+      &tagPre,
+      &tagIgnored,
+      &tagSpan,
+      &tagIgnored,
+      &tagIgnored,
+      &tagTitle,
+      &tagUnorderedList,
+      &tagImage,
+      &tagSeperator,
+      &tagBold,
+      &tagBold,
+      &tagItalic,
+      &tagItalic,
+      &tagItalic,
+      &tagItalic,
+      &tagUnderline,
+      &tagStrighthrought,
+      &tagStrighthrought,
+      &tagBlockquote,
+      &tagHeader1,
+      &tagHeader2,
+      &tagHeader3,
+      &tagHeader4,
+      &tagHeader5,
+      &tagHeader6,
+      &tagTable,
+      &tagTableRow,
+      &tagTableHeader,
+      &tagTableData,
+  };
 
-  tags_[kTagBlockquote] = make_shared<Converter::TagBlockquote>();
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) ==
+                    static_cast<size_t>(TagId::kCount),
+                "handlers doesn't match TagId");
 
-  // Tables
-  tags_[kTagTable] = make_shared<Converter::TagTable>();
-  tags_[kTagTableRow] = make_shared<Converter::TagTableRow>();
-  tags_[kTagTableHeader] = make_shared<Converter::TagTableHeader>();
-  tags_[kTagTableData] = make_shared<Converter::TagTableData>();
+  return handlers[static_cast<size_t>(id)];
 }
 
 void Converter::CleanUpMarkdown() {
-  TidyAllLines(&md_);
-  std::string buffer;
-  buffer.reserve(md_.size());
-
-  // Replace HTML symbols during the initial pass unless the user requested
-  // to keep HTML entities intact (e.g. keep `&nbsp;`)
-  if (!option.keepHtmlEntities) {
-    for (size_t i = 0; i < md_.size();) {
-      bool replaced = false;
-
-      // C++11 compatible iteration over htmlSymbolConversions_
-      for (const auto &symbol_replacement : htmlSymbolConversions_) {
-        const std::string &symbol = symbol_replacement.first;
-        const std::string &replacement = symbol_replacement.second;
-
-        if (md_.compare(i, symbol.size(), symbol) == 0) {
-          buffer.append(replacement);
-          i += symbol.size();
-          replaced = true;
-          break;
-        }
-      }
+  cleanup_buffer_.clear();
+  CleanUp(md_.data(), md_.size(), true, &cleanup_buffer_);
+
+  // Swapping keeps the capacity of both buffers for the next call
+  md_.swap(cleanup_buffer_);
+}
+
+void Converter::CleanUp(const char *markdown, size_t size, bool last,
+                        string *out) {
+  size_t line_start = 0;
+
+  while (line_start < size) {
+    const auto *newline = static_cast<const char *>(
+        memchr(markdown + line_start, '\n', size - line_start));
+
+    // Only the last part can end in the middle of a line
+    size_t line_end = newline ? newline - markdown : size;
+    CleanUpLine(markdown + line_start, line_end - line_start, out);
+
+    line_start = line_end + 1;
+  }
+
+  if (last) {
+    // The line breaks at the end
+    for (; cleanup_.pending_newlines != 0; --cleanup_.pending_newlines)
+      RewriteSequences(0, "\n", 1, out);
+
+    FinishSequences(0, out);
+  }
+}
+
+void Converter::CleanUpLine(const char *line, size_t size, string *out) {
+  // Code blocks are copied as they are
+  if (size >= 3 && ((line[0] == '`' && line[1] == '`' && line[2] == '`') ||
+                    (line[0] == '~' && line[1] == '~' && line[2] == '~')))
+    cleanup_.in_code_block = !cleanup_.in_code_block;
+
+  if (cleanup_.in_code_block) {
+    EmitLine(line, size, out);
+    return;
+  }
+
+  size_t trim_start = 0;
+  size_t trim_end = size;
+
+  // Trim leading whitespace
+  if (option.forceLeftTrim || (size > 0 && line[0] != '\t')) {
+    while (trim_start < trim_end &&
+           std::isspace(static_cast<unsigned char>(line[trim_start])))
+      ++trim_start;
+  }
+
+  // Trim trailing whitespace, preserve "  "
+  bool has_line_break = trim_end >= trim_start + 2 &&
+                        line[trim_end - 1] == ' ' && line[trim_end - 2] == ' ';
+  if (has_line_break)
+    trim_end -= 2;
+
+  while (trim_end > trim_start &&
+         std::isspace(static_cast<unsigned char>(line[trim_end - 1])))
+    --trim_end;
 
-      if (!replaced) {
-        buffer.push_back(md_[i++]);
+  if (has_line_break)
+    trim_end += 2;
+
+  if (trim_end == trim_start) {
+    // Reduce consecutive empty lines, and drop them at the beginning
+    if (cleanup_.amount_newlines < 2 && cleanup_.has_output) {
+      ++cleanup_.pending_newlines;
+      ++cleanup_.amount_newlines;
+    }
+
+    return;
+  }
+
+  cleanup_.amount_newlines = 0;
+  EmitLine(line + trim_start, trim_end - trim_start, out);
+}
+
+void Converter::EmitLine(const char *line, size_t size, string *out) {
+  cleanup_.has_output = true;
+
+  // Put the line breaks in front of the line
+  size_t newlines = cleanup_.pending_newlines;
+  if (newlines != 0) {
+    cleanup_line_.assign(newlines, '\n');
+    cleanup_line_.append(line, size);
+    line = cleanup_line_.data();
+    size = cleanup_line_.size();
+  }
+
+  // The line break of this line is sent with the next one
+  cleanup_.pending_newlines = 1;
+
+  // Replace HTML symbols after trimming (a decoded `&nbsp;` is kept) unless
+  // the user requested to keep HTML entities intact
+  if (option.keepHtmlEntities)
+    RewriteSequences(0, line, size, out);
+  else
+    DecodeHtmlSymbols(line, size, newlines, out);
+}
+
+void Converter::BuildSymbolTrie() {
+  symbol_trie_.assign(1, SymbolNode());
+  symbol_replacements_.clear();
+  symbol_first_bytes_.clear();
+
+  for (const auto &symbol_replacement : htmlSymbolConversions_) {
+    const string &symbol = symbol_replacement.first;
+    if (symbol.empty())
+      continue;
+
+    uint32_t node = 0;
+    for (char ch : symbol) {
+      uint32_t child = symbol_trie_[node].first_child;
+      while (child != 0 && symbol_trie_[child].ch != ch)
+        child = symbol_trie_[child].next_sibling;
+
+      if (child == 0) {
+        SymbolNode added;
+        added.ch = ch;
+        added.next_sibling = symbol_trie_[node].first_child;
+
+        child = static_cast<uint32_t>(symbol_trie_.size());
+        symbol_trie_[node].first_child = child;
+        symbol_trie_.push_back(added);
       }
+
+      node = child;
+    }
+
+    symbol_trie_[node].replacement =
+        static_cast<int32_t>(symbol_replacements_.size());
+    symbol_replacements_.push_back(symbol_replacement.second);
+
+    if (symbol_first_bytes_.find(symbol[0]) == string::npos)
+      symbol_first_bytes_ += symbol[0];
+  }
+
+  symbol_trie_dirty_ = false;
+}
+
+size_t Converter::MatchSymbol(const char *text, size_t size, size_t pos,
+                              int32_t *replacement) const {
+  size_t longest = 0;
+  uint32_t node = 0;
+
+  for (size_t i = pos; i < size; ++i) {
+    uint32_t child = symbol_trie_[node].first_child;
+    while (child != 0 && symbol_trie_[child].ch != text[i])
+      child = symbol_trie_[child].next_sibling;
+
+    if (child == 0)
+      break;
+
+    node = child;
+    if (symbol_trie_[node].replacement >= 0) {
+      longest = i + 1 - pos;
+      *replacement = symbol_trie_[node].replacement;
     }
-  } else {
-    // Keep entities as-is: copy through without transforming
-    buffer.append(md_);
   }
 
-  // Use swap instead of move assignment for better pre-C++11 compatibility
-  md_.swap(buffer);
-
-  // Optimized replacement sequence
-  // Note: Multiple simple passes are faster than one complex pass due to:
-  // - Better branch prediction
-  // - Better cache locality
-  // - Simpler instruction patterns
-  const char *replacements[][2] = {
-      {" , ", ", "},   {"\n.\n", ".\n"},   {"\n↵\n", " ↵\n"}, {"\n*\n", "\n"},
-      {"\n. ", ".\n"}, {"\t\t  ", "\t\t"},
+  return longest;
+}
+
+void Converter::DecodeHtmlSymbols(const char *text, size_t size, size_t from,
+                                  string *out) {
+  if (symbol_trie_dirty_)
+    BuildSymbolTrie();
+
+  // Jump from one possible symbol start to the next, usually an '&'
+  auto next_start = [&](size_t from) {
+    if (symbol_first_bytes_.size() == 1) {
+      const auto *start = static_cast<const char *>(
+          memchr(text + from, symbol_first_bytes_[0], size - from));
+      return start ? static_cast<size_t>(start - text) : size;
+    }
+
+    for (; from < size; ++from)
+      if (symbol_first_bytes_.find(text[from]) != string::npos)
+        return from;
+
+    return size;
   };
 
-  for (const auto &replacement : replacements) {
-    ReplaceAll(&md_, replacement[0], replacement[1]);
+  size_t copied = 0;
+
+  for (size_t i = next_start(from); i < size; i = next_start(i)) {
+    int32_t replacement = -1;
+    size_t length = MatchSymbol(text, size, i, &replacement);
+
+    if (length == 0) {
+      ++i;
+      continue;
+    }
+
+    const string &value = symbol_replacements_[replacement];
+    RewriteSequences(0, text + copied, i - copied, out);
+    RewriteSequences(0, value.data(), value.size(), out);
+    i += length;
+    copied = i;
+  }
+
+  RewriteSequences(0, text + copied, size - copied, out);
+}
+
+void Converter::RewriteSequences(size_t sequence, const char *text,
+                                 size_t size, string *out) {
+  if (sequence == kSequenceCount) {
+    out->append(text, size);
+    return;
+  }
+
+  const Sequence &seq = kSequences[sequence];
+  char *partial = cleanup_.partial[sequence];
+  uint8_t &partial_size = cleanup_.partial_size[sequence];
+
+  size_t i = 0;
+
+  // A match may have started at the end of the previous text. Put the held
+  // back characters in front of as much of this text as is needed to decide.
+  if (partial_size != 0) {
+    char window[sizeof(cleanup_.partial[0]) * 2];
+    size_t held = partial_size;
+    size_t from_text = std::min(size, seq.from_size - 1);
+
+    memcpy(window, partial, held);
+    memcpy(window + held, text, from_text);
+    size_t window_size = held + from_text;
+    partial_size = 0;
+
+    size_t start = 0;
+    for (; start < held; ++start) {
+      size_t available = std::min(window_size - start, seq.from_size);
+      if (memcmp(window + start, seq.from, available) != 0)
+        continue;
+
+      RewriteSequences(sequence + 1, window, start, out);
+
+      if (available != seq.from_size) {
+        // All of the text is part of the possible match
+        memcpy(partial, window + start, available);
+        partial_size = static_cast<uint8_t>(available);
+        return;
+      }
+
+      RewriteSequences(sequence + 1, seq.to, seq.to_size, out);
+      i = start + seq.from_size - held;
+      break;
+    }
+
+    if (start == held)
+      RewriteSequences(sequence + 1, window, held, out);
+  }
+
+  // Matches within the text are found in place, everything between them is
+  // handed over in one go
+  size_t copied = i;
+
+  while (i < size) {
+    const auto *start =
+        static_cast<const char *>(memchr(text + i, seq.from[0], size - i));
+    if (!start)
+      break;
+
+    size_t match = start - text;
+    size_t available = size - match;
+
+    if (available >= seq.from_size) {
+      if (memcmp(start, seq.from, seq.from_size) != 0) {
+        i = match + 1;
+        continue;
+      }
+
+      RewriteSequences(sequence + 1, text + copied, match - copied, out);
+      RewriteSequences(sequence + 1, seq.to, seq.to_size, out);
+      i = copied = match + seq.from_size;
+      continue;
+    }
+
+    // The text ends with what might be the start of a match
+    if (memcmp(start, seq.from, available) == 0) {
+      RewriteSequences(sequence + 1, text + copied, match - copied, out);
+      memcpy(partial, start, available);
+      partial_size = static_cast<uint8_t>(available);
+      return;
+    }
+
+    i = match + 1;
+  }
+
+  RewriteSequences(sequence + 1, text + copied, size - copied, out);
+}
+
+void Converter::FinishSequences(size_t sequence, string *out) {
+  if (sequence == kSequenceCount)
+    return;
+
+  // Flushing a partial match can't complete one, it's too short
+  uint8_t &partial_size = cleanup_.partial_size[sequence];
+  RewriteSequences(sequence + 1, cleanup_.partial[sequence], partial_size,
+                   out);
+  partial_size = 0;
+
+  FinishSequences(sequence + 1, out);
+}
+
+size_t Converter::FlushableMarkdown() const {
+  // The current line can still change (wrapping, escaping, headers), and
+  // closing tags remove up to two characters or trailing newlines in front of
+  // it. Keep two more lines with some content as a margin.
+  if (chars_in_curr_line_ > md_.size())
+    return 0;
+
+  size_t end = md_.size() - chars_in_curr_line_;
+
+  // A table is reformatted as a whole once it's closed
+  if (is_in_table_)
+    end = std::min(end, table_start);
+
+  size_t newlines = 0;
+  size_t content = 0;
+
+  while (end > 0) {
+    char ch = md_[--end];
+
+    if (ch != '\n')
+      ++content;
+    else if (++newlines > 2 && content > 1)
+      return end + 1;
   }
+
+  return 0;
+}
+
+void Converter::FlushMarkdown() {
+  size_t end = FlushableMarkdown();
+
+  if (end == 0) {
+    // Try again once the Markdown has doubled so huge lines or tables stay
+    // linear
+    flush_at_ = md_.size() + std::max(flush_threshold_, md_.size());
+    return;
+  }
+
+  flush_buffer_.clear();
+  CleanUp(md_.data(), end, false, &flush_buffer_);
+
+  md_.erase(0, end);
+  if (is_in_table_)
+    table_start -= end;
+
+  sink_->write(flush_buffer_.data(), flush_buffer_.size());
+
+  flush_at_ = md_.size() + flush_threshold_;
 }
 
 Converter *Converter::appendToMd(char ch) {
@@ -235,13 +851,15 @@ Converter *Converter::appendToMd(char ch) {
 }
 
 Converter *Converter::appendToMd(const char *str) {
+  return appendToMd(str, strlen(str));
+}
+
+Converter *Converter::appendToMd(const char *str, size_t str_len) {
   if (IsInIgnoredTag())
     return this;
 
-  md_ += str;
+  md_.append(str, str_len);
 
-  auto str_len = strlen(str);
-  
   // Efficiently update chars_in_curr_line_ by scanning for last newline
   for (size_t i = 0; i < str_len; ++i) {
     if (str[i] == '\n')
@@ -300,171 +918,93 @@ Converter *Converter::Trim(string *s) {
   return this;
 }
 
-void Converter::TidyAllLines(string *str) {
-  if (str->empty())
-    return;
+void Converter::ParseAttributes() {
+  attributes_.clear();
+  attributes_parsed_ = true;
 
-  // Ensure input ends with newline to simplify logic
-  if (str->back() != '\n') {
-    str->push_back('\n');
-  }
+  const char *tag = TagBegin();
+  size_t size = TagSize();
 
-  size_t read = 0;
-  size_t write = 0;
-  size_t len = str->size();
+  if (size != 0 && tag[size - 1] == '>')
+    --size;
 
-  uint8_t amount_newlines = 0;
-  bool in_code_block = false;
+  auto is_space = [](char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f';
+  };
 
-  while (read < len) {
-    size_t line_start = read;
-    size_t line_end = read;
+  // Skip the tag name
+  size_t pos = 0;
+  while (pos < size && !is_space(tag[pos]) && tag[pos] != '/')
+    ++pos;
 
-    // Find end of line
-    while (line_end < len && (*str)[line_end] != '\n') {
-      line_end++;
-    }
+  while (pos < size) {
+    while (pos < size && (is_space(tag[pos]) || tag[pos] == '/'))
+      ++pos;
 
-    size_t line_len = line_end - line_start;
+    if (pos == size)
+      break;
 
-    // Check for code block markers
-    if (line_len >= 3) {
-      char c1 = (*str)[line_start];
-      char c2 = (*str)[line_start + 1];
-      char c3 = (*str)[line_start + 2];
-      if ((c1 == '`' && c2 == '`' && c3 == '`') ||
-          (c1 == '~' && c2 == '~' && c3 == '~')) {
-        in_code_block = !in_code_block;
-      }
-    }
+    Attribute attribute = {pos, 0, 0, 0};
 
-    if (in_code_block) {
-      // Copy line as-is
-      if (write != line_start) {
-        for (size_t i = 0; i < line_len; ++i) {
-          (*str)[write + i] = (*str)[line_start + i];
-        }
-      }
-      write += line_len;
-      (*str)[write++] = '\n';
-    } else {
-      // Trim logic
-      size_t trim_start = line_start;
-      size_t trim_end = line_end;
-
-      // Trim leading whitespace
-      if (option.forceLeftTrim ||
-          (trim_start < trim_end && (*str)[trim_start] != '\t')) {
-        while (trim_start < trim_end &&
-               std::isspace((unsigned char)(*str)[trim_start])) {
-          ++trim_start;
-        }
-      }
+    while (pos < size && !is_space(tag[pos]) && tag[pos] != '/' &&
+           tag[pos] != '=')
+      ++pos;
+    attribute.name_size = pos - attribute.name;
 
-      // Trim trailing whitespace, preserve "  "
-      bool has_line_break = false;
-      if (trim_end >= trim_start + 2 && (*str)[trim_end - 1] == ' ' &&
-          (*str)[trim_end - 2] == ' ') {
-        has_line_break = true;
-        trim_end -= 2;
-      }
+    while (pos < size && is_space(tag[pos]))
+      ++pos;
 
-      while (trim_end > trim_start &&
-             std::isspace((unsigned char)(*str)[trim_end - 1])) {
-        --trim_end;
-      }
-
-      if (has_line_break) {
-        trim_end += 2;
-      }
+    if (pos < size && tag[pos] == '=') {
+      ++pos;
+      while (pos < size && is_space(tag[pos]))
+        ++pos;
 
-      size_t trimmed_len = trim_end - trim_start;
-
-      if (trimmed_len == 0) {
-        // Empty line
-        if (amount_newlines < 2 && write > 0) {
-          (*str)[write++] = '\n';
-          amount_newlines++;
-        }
+      if (pos < size && (tag[pos] == '"' || tag[pos] == '\'')) {
+        char quote = tag[pos++];
+        attribute.value = pos;
+        while (pos < size && tag[pos] != quote)
+          ++pos;
+        attribute.value_size = pos - attribute.value;
+        ++pos; // Closing quote
       } else {
-        amount_newlines = 0;
-        if (write != trim_start) {
-          for (size_t i = 0; i < trimmed_len; ++i) {
-            (*str)[write + i] = (*str)[trim_start + i];
-          }
-        }
-        write += trimmed_len;
-        (*str)[write++] = '\n';
+        attribute.value = pos;
+        while (pos < size && !is_space(tag[pos]))
+          ++pos;
+        attribute.value_size = pos - attribute.value;
       }
     }
 
-    read = line_end + 1;
-  }
+    // '=' without a name before it
+    if (attribute.name_size == 0)
+      continue;
 
-  str->resize(write);
+    attributes_.push_back(attribute);
+  }
 }
 
-string Converter::ExtractAttributeFromTagLeftOf(const string &attr) {
-  // Extract the whole tag from current offset, e.g. from '>', backwards
-  auto tag = html_.substr(offset_lt_, index_ch_in_html_ - offset_lt_);
-  string lowerTag = toLower(tag); // Convert tag to lowercase for comparison
-
-  // locate given attribute (case-insensitive)
-  auto offset_attr = lowerTag.find(attr);
-
-  if (offset_attr == string::npos)
-    return "";
-
-  // locate attribute-value pair's '='
-  auto offset_equals = tag.find('=', offset_attr);
+Converter::AttributeValue Converter::ExtractAttribute(const char *name) {
+  if (!attributes_parsed_)
+    ParseAttributes();
 
-  if (offset_equals == string::npos)
-    return "";
-
-  // locate value's surrounding quotes
-  auto offset_double_quote = tag.find('"', offset_equals);
-  auto offset_single_quote = tag.find('\'', offset_equals);
-
-  bool has_double_quote = offset_double_quote != string::npos;
-  bool has_single_quote = offset_single_quote != string::npos;
+  const char *tag = TagBegin();
+  size_t name_size = strlen(name);
 
-  if (!has_double_quote && !has_single_quote)
-    return "";
-
-  char wrapping_quote = 0;
+  for (const auto &attribute : attributes_) {
+    if (attribute.name_size != name_size)
+      continue;
 
-  size_t offset_opening_quote = 0;
-  size_t offset_closing_quote = 0;
+    size_t i = 0;
+    while (i < name_size &&
+           tolower(static_cast<unsigned char>(tag[attribute.name + i])) ==
+               name[i])
+      ++i;
 
-  if (has_double_quote) {
-    if (!has_single_quote) {
-      wrapping_quote = '"';
-      offset_opening_quote = offset_double_quote;
-    } else {
-      if (offset_double_quote < offset_single_quote) {
-        wrapping_quote = '"';
-        offset_opening_quote = offset_double_quote;
-      } else {
-        wrapping_quote = '\'';
-        offset_opening_quote = offset_single_quote;
-      }
-    }
-  } else {
-    // has only single quote
-    wrapping_quote = '\'';
-    offset_opening_quote = offset_single_quote;
+    // The first one wins if an attribute is repeated
+    if (i == name_size)
+      return {tag + attribute.value, attribute.value_size};
   }
 
-  if (offset_opening_quote == string::npos)
-    return "";
-
-  offset_closing_quote = tag.find(wrapping_quote, offset_opening_quote + 1);
-
-  if (offset_closing_quote == string::npos)
-    return "";
-
-  return tag.substr(offset_opening_quote + 1,
-                    offset_closing_quote - 1 - offset_opening_quote);
+  return {};
 }
 
 void Converter::TurnLineIntoHeader1() {
@@ -481,13 +1021,73 @@ void Converter::TurnLineIntoHeader2() {
 
 string Converter::convert() {
   // We already converted
-  if (index_ch_in_html_ == html_.size())
+  if (index_ch_in_html_ == html_size_)
     return md_;
 
   reset();
 
-  for (char ch : html_) {
-    ++index_ch_in_html_;
+  ParseHtml(html(), html_size_);
+  FinishMarkdown();
+
+  return md_;
+}
+
+void Converter::setSink(Sink *sink, size_t flush_threshold) {
+  sink_ = sink;
+  flush_threshold_ = flush_threshold;
+  flush_at_ = sink_ ? md_.size() + flush_threshold_ : SIZE_MAX;
+}
+
+void Converter::feed(const char *chunk, size_t size) {
+  if (!is_streaming_) {
+    reset(nullptr, 0);
+    is_streaming_ = true;
+  }
+
+  // Offsets are relative to the chunk, only the tag being parsed is kept
+  index_ch_in_html_ = 0;
+  ParseHtml(chunk, size);
+}
+
+string Converter::finish() {
+  if (is_streaming_)
+    FinishMarkdown();
+
+  is_streaming_ = false;
+  index_ch_in_html_ = html_size_;
+
+  return md_;
+}
+
+void Converter::ParseHtml(const char *input, size_t size) {
+  // Stage one finds the characters that need a closer look, stage two hands
+  // them to the per-character state machine and bulk-appends the text between
+  StructuralIndex structural(input, size, option.compressWhitespace);
+
+  while (index_ch_in_html_ < size) {
+    if (md_.size() >= flush_at_)
+      FlushMarkdown();
+
+    if (!is_in_tag_ && reference_.empty()) {
+      size_t run = structural.next(index_ch_in_html_) - index_ch_in_html_;
+
+      if (run > 1) {
+        size_t appended = AppendTextRun(input + index_ch_in_html_, run);
+        index_ch_in_html_ += appended;
+
+        if (appended != 0)
+          continue;
+      }
+    }
+
+    char ch = input[index_ch_in_html_++];
+
+    if (!reference_.empty()) {
+      if (ContinueReference(ch))
+        continue;
+
+      FlushReference(ch);
+    }
 
     if (!is_in_tag_ && ch == '<') {
       OnHasEnteredTag();
@@ -495,28 +1095,55 @@ string Converter::convert() {
       continue;
     }
 
-    if (is_in_tag_)
+    if (is_in_tag_) {
+      if (is_streaming_)
+        tag_buffer_ += ch;
+
       ParseCharInTag(ch);
-    else
+    } else if (ch == '&' && decode_character_references_ &&
+               !option.keepHtmlEntities) {
+      reference_ += ch;
+    } else {
       ParseCharInTagContent(ch);
+    }
   }
+}
+
+void Converter::FinishMarkdown(size_t parts) {
+  if (!reference_.empty())
+    FlushReference(0);
 
-  CleanUpMarkdown();
+  // With a sink, the rest of the cleanup state is carried over from
+  // FlushMarkdown(). The output written so far never ends with '\n', those
+  // are held back as a possible start of a sequence.
+  if (parts > 1)
+    CleanUpMarkdownParallel(parts);
+  else
+    CleanUpMarkdown();
 
   // Remove trailing double newline if present (keep only single newline)
   if (md_.size() >= 2 && md_[md_.size() - 1] == '\n' && md_[md_.size() - 2] == '\n') {
     md_.pop_back();
   }
 
-  return md_;
+  if (sink_) {
+    sink_->write(md_.data(), md_.size());
+    md_.clear();
+  }
 }
 
 void Converter::OnHasEnteredTag() {
   offset_lt_ = index_ch_in_html_;
+  tag_buffer_.clear();
+  attributes_parsed_ = false;
   is_in_tag_ = true;
   is_closing_tag_ = false;
   prev_tag_ = current_tag_;
-  current_tag_ = "";
+  current_tag_ = TagId::kUnknown;
+  tag_name_size_ = 0;
+  is_tag_name_complete_ = false;
+  last_ch_in_tag_ = 0;
+  skipping_leading_whitespace_ = true;
 
   if (!md_.empty()) {
     UpdatePrevChFromMd();
@@ -535,21 +1162,15 @@ Converter *Converter::UpdatePrevChFromMd() {
 }
 
 bool Converter::ParseCharInTag(char ch) {
-  static bool skipping_leading_whitespace = true;
-
   if (ch == '/' && !is_in_attribute_value_) {
-    is_closing_tag_ = current_tag_.empty();
+    is_closing_tag_ = tag_name_size_ == 0;
     is_self_closing_tag_ = !is_closing_tag_;
-    skipping_leading_whitespace = true; // Reset for next tag
+    skipping_leading_whitespace_ = true; // Reset for next tag
     return true;
   }
 
   if (ch == '>') {
-    // Trim trailing whitespace by removing characters from current_tag_
-    while (!current_tag_.empty() && std::isspace(current_tag_.back())) {
-      current_tag_.pop_back();
-    }
-    skipping_leading_whitespace = true; // Reset for next tag
+    skipping_leading_whitespace_ = true; // Reset for next tag
     if (!is_self_closing_tag_)
       return OnHasLeftTag();
     else {
@@ -563,49 +1184,65 @@ bool Converter::ParseCharInTag(char ch) {
   if (ch == '"') {
     if (is_in_attribute_value_) {
       is_in_attribute_value_ = false;
-    } else {
-      size_t pos = current_tag_.length();
-      while (pos > 0 && isspace(current_tag_[pos - 1])) {
-        pos--;
-      }
-      if (pos > 0 && current_tag_[pos - 1] == '=') {
-        is_in_attribute_value_ = true;
-      }
+    } else if (last_ch_in_tag_ == '=') {
+      is_in_attribute_value_ = true;
     }
-    skipping_leading_whitespace = false; // Stop skipping after attribute
+    skipping_leading_whitespace_ = false; // Stop skipping after attribute
     return true;
   }
 
+  bool is_space = isspace(ch);
+
   // Handle whitespace: skip leading whitespace, keep others
-  if (isspace(ch) && skipping_leading_whitespace) {
+  if (is_space && skipping_leading_whitespace_) {
     return true; // Ignore leading whitespace
   }
 
   // Once we encounter a non-whitespace character, stop skipping
-  skipping_leading_whitespace = false;
-  current_tag_ += tolower(ch);
+  skipping_leading_whitespace_ = false;
+
+  if (!is_space)
+    last_ch_in_tag_ = ch;
+
+  // The name ends at the first whitespace, the attributes follow
+  if (is_space) {
+    is_tag_name_complete_ = true;
+  } else if (!is_tag_name_complete_) {
+    if (tag_name_size_ < kTagNameCapacity)
+      tag_name_[tag_name_size_] = static_cast<char>(tolower(ch));
+    ++tag_name_size_;
+  }
+
   return false;
 }
 
+bool Converter::TagContainsAttributesToHide() const {
+  const char *tag = TagBegin();
+  size_t size = TagSize();
+
+  return ContainsIgnoreCase(tag, size, " aria=\"hidden\"") ||
+         ContainsIgnoreCase(tag, size, "display:none") ||
+         ContainsIgnoreCase(tag, size, "visibility:hidden") ||
+         ContainsIgnoreCase(tag, size, "opacity:0") ||
+         ContainsIgnoreCase(tag, size, "details-content--hidden-not-important");
+}
+
 bool Converter::OnHasLeftTag() {
   is_in_tag_ = false;
 
   UpdatePrevChFromMd();
 
   if (!is_closing_tag_)
-    if (TagContainsAttributesToHide(&current_tag_))
+    if (TagContainsAttributesToHide())
       return true;
 
-  // Extract tag name without Split() - just find first space
-  size_t space_pos = current_tag_.find(' ');
-  if (space_pos != string::npos) {
-    current_tag_ = current_tag_.substr(0, space_pos);
-  }
-  
-  if (current_tag_.empty())
+  if (tag_name_size_ == 0)
     return true;
 
-  auto tag = tags_[current_tag_];
+  if (tag_name_size_ <= kTagNameCapacity)
+    current_tag_ = LookupTag(tag_name_, tag_name_size_);
+
+  const Tag *tag = TagHandler(current_tag_);
 
   if (!tag)
     return true;
@@ -623,7 +1260,11 @@ bool Converter::OnHasLeftTag() {
 }
 
 Converter *Converter::ShortenMarkdown(size_t chars) {
-  md_ = md_.substr(0, md_.length() - chars);
+  // Shrinking in place keeps the capacity and copies nothing
+  if (chars <= md_.size()) {
+    md_.resize(md_.size() - chars);
+    md_look_back_ = std::min(md_look_back_, md_.size());
+  }
 
   if (chars > chars_in_curr_line_)
     chars_in_curr_line_ = 0;
@@ -654,7 +1295,7 @@ bool Converter::ParseCharInTagContent(char ch) {
     }
   }
 
-  if (IsInIgnoredTag() || current_tag_ == kTagLink) {
+  if (IsInIgnoredTag() || current_tag_ == TagId::kLink) {
     prev_ch_in_html_ = ch;
 
     return true;
@@ -685,6 +1326,7 @@ bool Converter::ParseCharInTagContent(char ch) {
     if (chars_in_curr_line_ > 0) {
       size_t start_idx = md_.length() - chars_in_curr_line_;
       size_t idx = start_idx;
+      md_look_back_ = std::min(md_look_back_, start_idx);
       // Skip spaces
       while (idx < md_.length() && isspace(md_[idx])) {
         idx++;
@@ -716,7 +1358,7 @@ bool Converter::ParseCharInTagContent(char ch) {
   }
 
   if (chars_in_curr_line_ > option.softBreak && !is_in_table_ && !is_in_list_ &&
-      current_tag_ != kTagImg && current_tag_ != kTagAnchor &&
+      current_tag_ != TagId::kImg && current_tag_ != TagId::kAnchor &&
       option.splitLines) {
     if (ch == ' ') { // If the next char is - it will become a list
       md_ += '\n';
@@ -729,9 +1371,104 @@ bool Converter::ParseCharInTagContent(char ch) {
   return false;
 }
 
+size_t Converter::AppendTextRun(const char *text, size_t length) {
+  if (is_in_code_) {
+    md_.append(text, length);
+    return length;
+  }
+
+  if (IsInIgnoredTag() || current_tag_ == TagId::kLink) {
+    prev_ch_in_html_ = text[length - 1];
+    return length;
+  }
+
+  if (option.splitLines && !is_in_table_ && !is_in_list_ &&
+      current_tag_ != TagId::kImg && current_tag_ != TagId::kAnchor) {
+    // Only append up to the soft break, anything after that might have to be
+    // wrapped and is left to ParseCharInTagContent()
+    auto soft_break = static_cast<size_t>(option.softBreak);
+    if (chars_in_curr_line_ >= soft_break)
+      return 0;
+
+    length = std::min(length, soft_break - chars_in_curr_line_);
+  }
+
+  md_.append(text, length);
+  chars_in_curr_line_ += length;
+
+  return length;
+}
+
+bool Converter::ContinueReference(char ch) {
+  if (reference_.size() >= kReferenceCapacity)
+    return false;
+
+  if (isalnum(static_cast<unsigned char>(ch)) ||
+      (ch == '#' && reference_.size() == 1)) {
+    reference_ += ch;
+    return true;
+  }
+
+  if (ch == ';') {
+    reference_ += ch;
+    FlushReference(0);
+    return true;
+  }
+
+  return false;
+}
+
+void Converter::FlushReference(char next) {
+  if (symbol_trie_dirty_)
+    BuildSymbolTrie();
+
+  // A '=' keeps a legacy name without ';' as it is
+  size_t size = reference_.size();
+  if (next == '=')
+    reference_ += next;
+
+  const char *value = nullptr;
+  size_t value_size = 0;
+  size_t length = 0;
+  char buffer[4];
+
+  // Conversions are applied by the cleanup, they take precedence
+  int32_t replacement = -1;
+  if (MatchSymbol(reference_.data(), reference_.size(), 0, &replacement) == 0)
+    length = DecodeCharacterReference(reference_.data(), reference_.size(), 0,
+                                      buffer, &value, &value_size);
+
+  if (length != 0)
+    AppendDecodedText(value, value_size);
+
+  // Whatever wasn't decoded is plain text
+  for (size_t i = length; i < size; ++i)
+    ParseCharInTagContent(reference_[i]);
+
+  reference_.clear();
+}
+
+void Converter::AppendDecodedText(const char *text, size_t size) {
+  bool escape =
+      !is_in_code_ && !IsInIgnoredTag() && current_tag_ != TagId::kLink;
+
+  for (size_t i = 0; i < size; ++i) {
+    char ch = text[i];
+
+    // A reference stands for the character, never for Markdown syntax.
+    // ParseCharInTagContent() escapes '*', '`' and backslashes itself.
+    if (escape && (ch == '_' || ch == '[' || ch == ']' || ch == '|' ||
+                   ch == '#' || ch == '<'))
+      appendToMd('\\');
+
+    ParseCharInTagContent(ch);
+  }
+}
+
 bool Converter::ReplacePreviousSpaceInLineByNewline() {
-  if (current_tag_ == kTagParagraph ||
-      is_in_table_ && (prev_tag_ != kTagCode && prev_tag_ != kTagPre))
+  if (current_tag_ == TagId::kParagraph ||
+      is_in_table_ &&
+          (prev_tag_ != TagId::kCode && prev_tag_ != TagId::kPre))
     return false;
 
   auto offset = md_.length() - 1;
@@ -740,6 +1477,8 @@ bool Converter::ReplacePreviousSpaceInLineByNewline() {
     return true;
 
   do {
+    md_look_back_ = std::min(md_look_back_, offset);
+
     if (md_[offset] == '\n')
       return false;
 
@@ -756,66 +1495,74 @@ bool Converter::ReplacePreviousSpaceInLineByNewline() {
   return false;
 }
 
-void Converter::TagAnchor::OnHasLeftOpeningTag(Converter *c) {
-  if (c->prev_tag_ == kTagImg)
+void Converter::TagAnchor::OnHasLeftOpeningTag(Converter *c) const {
+  c->anchor_opened_ = true;
+
+  if (c->prev_tag_ == TagId::kImg)
     c->appendToMd('\n');
 
-  current_title_ = c->ExtractAttributeFromTagLeftOf(kAttributeTitle);
+  auto title = c->ExtractAttribute(kAttributeTitle);
+  c->current_title_.assign(title.data, title.size);
 
   c->appendToMd('[');
-  current_href_ = c->ExtractAttributeFromTagLeftOf(kAttributeHref);
+
+  auto href = c->ExtractAttribute(kAttributeHref);
+  c->current_href_.assign(href.data, href.size);
 }
 
-void Converter::TagAnchor::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagAnchor::OnHasLeftClosingTag(Converter *c) const {
+  if (!c->anchor_opened_)
+    c->anchor_state_used_ = true;
+
   if (!c->shortIfPrevCh('[')) {
-    c->appendToMd("](")->appendToMd(current_href_);
+    c->appendToMd("](")->appendToMd(c->current_href_);
 
     // If title is set append it
-    if (!current_title_.empty()) {
-      c->appendToMd(" \"")->appendToMd(current_title_)->appendToMd('"');
-      current_title_.clear();
+    if (!c->current_title_.empty()) {
+      c->appendToMd(" \"")->appendToMd(c->current_title_)->appendToMd('"');
+      c->current_title_.clear();
     }
 
     c->appendToMd(')');
 
-    if (c->prev_tag_ == kTagImg)
+    if (c->prev_tag_ == TagId::kImg)
       c->appendToMd('\n');
   }
 }
 
-void Converter::TagBold::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagBold::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("**");
 }
 
-void Converter::TagBold::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagBold::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd("**");
 }
 
-void Converter::TagItalic::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagItalic::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd('*');
 }
 
-void Converter::TagItalic::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagItalic::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd('*');
 }
 
-void Converter::TagUnderline::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagUnderline::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("<u>");
 }
 
-void Converter::TagUnderline::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagUnderline::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd("</u>");
 }
 
-void Converter::TagStrikethrought::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagStrikethrought::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd('~');
 }
 
-void Converter::TagStrikethrought::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagStrikethrought::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd('~');
 }
 
-void Converter::TagBreak::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagBreak::OnHasLeftOpeningTag(Converter *c) const {
   if (c->is_in_list_) { // When it's in a list, it's not in a paragraph
     c->appendToMd("  \n");
     c->appendToMd(Repeat("  ", c->index_li));
@@ -825,9 +1572,9 @@ void Converter::TagBreak::OnHasLeftOpeningTag(Converter *c) {
     c->appendToMd("  \n");
 }
 
-void Converter::TagBreak::OnHasLeftClosingTag(Converter *c) {}
+void Converter::TagBreak::OnHasLeftClosingTag(Converter *c) const {}
 
-void Converter::TagDiv::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagDiv::OnHasLeftOpeningTag(Converter *c) const {
   if (c->prev_ch_in_md_ != '\n')
     c->appendToMd('\n');
 
@@ -835,63 +1582,80 @@ void Converter::TagDiv::OnHasLeftOpeningTag(Converter *c) {
     c->appendToMd('\n');
 }
 
-void Converter::TagDiv::OnHasLeftClosingTag(Converter *c) {}
+void Converter::TagDiv::OnHasLeftClosingTag(Converter *c) const {}
 
-void Converter::TagHeader1::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader1::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n# ");
 }
 
-void Converter::TagHeader1::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader1::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagHeader2::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader2::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n## ");
 }
 
-void Converter::TagHeader2::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader2::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagHeader3::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader3::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n### ");
 }
 
-void Converter::TagHeader3::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader3::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagHeader4::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader4::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n#### ");
 }
 
-void Converter::TagHeader4::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader4::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagHeader5::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader5::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n##### ");
 }
 
-void Converter::TagHeader5::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader5::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagHeader6::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagHeader6::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n###### ");
 }
 
-void Converter::TagHeader6::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagHeader6::OnHasLeftClosingTag(Converter *c) const {
   if (c->prev_prev_ch_in_md_ != ' ')
     c->appendToMd('\n');
 }
 
-void Converter::TagListItem::OnHasLeftOpeningTag(Converter *c) {
+void Converter::EnterList(bool ordered) {
+  list_stack_.push_back({is_in_ordered_list_, index_ol});
+  is_in_ordered_list_ = ordered;
+  index_ol = 0;
+}
+
+void Converter::LeaveList() {
+  if (list_stack_.empty()) {
+    is_in_ordered_list_ = false;
+    return;
+  }
+
+  is_in_ordered_list_ = list_stack_.back().is_ordered;
+  index_ol = list_stack_.back().index_ol;
+  list_stack_.pop_back();
+}
+
+void Converter::TagListItem::OnHasLeftOpeningTag(Converter *c) const {
   if (c->is_in_table_)
     return;
 
@@ -907,7 +1671,7 @@ void Converter::TagListItem::OnHasLeftOpeningTag(Converter *c) {
   c->appendToMd(num);
 }
 
-void Converter::TagListItem::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagListItem::OnHasLeftClosingTag(Converter *c) const {
   if (c->is_in_table_)
     return;
 
@@ -915,20 +1679,19 @@ void Converter::TagListItem::OnHasLeftClosingTag(Converter *c) {
     c->appendToMd('\n');
 }
 
-void Converter::TagOption::OnHasLeftOpeningTag(Converter *c) {}
+void Converter::TagOption::OnHasLeftOpeningTag(Converter *c) const {}
 
-void Converter::TagOption::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagOption::OnHasLeftClosingTag(Converter *c) const {
   if (c->md_.length() > 0)
     c->appendToMd("  \n");
 }
 
-void Converter::TagOrderedList::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagOrderedList::OnHasLeftOpeningTag(Converter *c) const {
   if (c->is_in_table_)
     return;
 
+  c->EnterList(true);
   c->is_in_list_ = true;
-  c->is_in_ordered_list_ = true;
-  c->index_ol = 0;
 
   ++c->index_li;
 
@@ -937,11 +1700,11 @@ void Converter::TagOrderedList::OnHasLeftOpeningTag(Converter *c) {
   c->appendToMd('\n');
 }
 
-void Converter::TagOrderedList::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagOrderedList::OnHasLeftClosingTag(Converter *c) const {
   if (c->is_in_table_)
     return;
 
-  c->is_in_ordered_list_ = false;
+  c->LeaveList();
 
   if (c->index_li != 0)
     --c->index_li;
@@ -951,16 +1714,16 @@ void Converter::TagOrderedList::OnHasLeftClosingTag(Converter *c) {
   c->appendToMd('\n');
 }
 
-void Converter::TagParagraph::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagParagraph::OnHasLeftOpeningTag(Converter *c) const {
   c->is_in_p_ = true;
 
-  if (c->is_in_list_ && c->prev_tag_ == kTagParagraph)
+  if (c->is_in_list_ && c->prev_tag_ == TagId::kParagraph)
     c->appendToMd("\n\t");
   else if (!c->is_in_list_)
     c->appendToMd('\n');
 }
 
-void Converter::TagParagraph::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagParagraph::OnHasLeftClosingTag(Converter *c) const {
   c->is_in_p_ = false;
 
   if (!c->md_.empty())
@@ -970,7 +1733,7 @@ void Converter::TagParagraph::OnHasLeftClosingTag(Converter *c) {
     c->appendToMd(Repeat("> ", c->index_blockquote));
 }
 
-void Converter::TagPre::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagPre::OnHasLeftOpeningTag(Converter *c) const {
   c->is_in_pre_ = true;
 
   if (c->prev_ch_in_md_ != '\n')
@@ -979,7 +1742,7 @@ void Converter::TagPre::OnHasLeftOpeningTag(Converter *c) {
   if (c->prev_prev_ch_in_md_ != '\n')
     c->appendToMd('\n');
 
-  if (c->is_in_list_ && c->prev_tag_ != kTagParagraph)
+  if (c->is_in_list_ && c->prev_tag_ != TagId::kParagraph)
     c->ShortenMarkdown(2);
 
   if (c->is_in_list_)
@@ -988,7 +1751,7 @@ void Converter::TagPre::OnHasLeftOpeningTag(Converter *c) {
     c->appendToMd("```");
 }
 
-void Converter::TagPre::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagPre::OnHasLeftClosingTag(Converter *c) const {
   c->is_in_pre_ = false;
 
   if (c->is_in_list_)
@@ -998,25 +1761,27 @@ void Converter::TagPre::OnHasLeftClosingTag(Converter *c) {
   c->appendToMd('\n'); // Don't combine because of blockquote
 }
 
-void Converter::TagCode::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagCode::OnHasLeftOpeningTag(Converter *c) const {
   c->is_in_code_ = true;
 
   if (c->is_in_pre_) {
     if (c->is_in_list_)
       return;
 
-    auto code = c->ExtractAttributeFromTagLeftOf(kAttributeClass);
-    if (!code.empty()) {
-      if (startsWith(code, "language-"))
-        code.erase(0, 9); // remove language-
-      c->appendToMd(code);
+    auto code = c->ExtractAttribute(kAttributeClass);
+    if (code.size != 0) {
+      if (code.size >= 9 && strncmp(code.data, "language-", 9) == 0) {
+        code.data += 9; // remove language-
+        code.size -= 9;
+      }
+      c->appendToMd(code.data, code.size);
     }
     c->appendToMd('\n');
   } else
     c->appendToMd('`');
 }
 
-void Converter::TagCode::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagCode::OnHasLeftClosingTag(Converter *c) const {
   c->is_in_code_ = false;
 
   if (c->is_in_pre_)
@@ -1025,18 +1790,23 @@ void Converter::TagCode::OnHasLeftClosingTag(Converter *c) {
   c->appendToMd('`');
 }
 
-void Converter::TagSpan::OnHasLeftOpeningTag(Converter *c) {}
+void Converter::TagSpan::OnHasLeftOpeningTag(Converter *c) const {}
 
-void Converter::TagSpan::OnHasLeftClosingTag(Converter *c) {}
+void Converter::TagSpan::OnHasLeftClosingTag(Converter *c) const {}
 
-void Converter::TagTitle::OnHasLeftOpeningTag(Converter *c) {}
+void Converter::TagTitle::OnHasLeftOpeningTag(Converter *c) const {}
 
-void Converter::TagTitle::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagTitle::OnHasLeftClosingTag(Converter *c) const {
   c->TurnLineIntoHeader1();
 }
 
-void Converter::TagUnorderedList::OnHasLeftOpeningTag(Converter *c) {
-  if (c->is_in_list_ || c->is_in_table_)
+void Converter::TagUnorderedList::OnHasLeftOpeningTag(Converter *c) const {
+  if (c->is_in_table_)
+    return;
+
+  c->EnterList(false);
+
+  if (c->is_in_list_)
     return;
 
   c->is_in_list_ = true;
@@ -1046,10 +1816,12 @@ void Converter::TagUnorderedList::OnHasLeftOpeningTag(Converter *c) {
   c->appendToMd('\n');
 }
 
-void Converter::TagUnorderedList::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagUnorderedList::OnHasLeftClosingTag(Converter *c) const {
   if (c->is_in_table_)
     return;
 
+  c->LeaveList();
+
   if (c->index_li != 0)
     --c->index_li;
 
@@ -1061,59 +1833,88 @@ void Converter::TagUnorderedList::OnHasLeftClosingTag(Converter *c) {
     c->appendToMd('\n');
 }
 
-void Converter::TagImage::OnHasLeftOpeningTag(Converter *c) {
-  if (c->prev_tag_ != kTagAnchor && c->prev_ch_in_md_ != '\n')
+void Converter::TagImage::OnHasLeftOpeningTag(Converter *c) const {
+  if (c->prev_tag_ != TagId::kAnchor && c->prev_ch_in_md_ != '\n')
     c->appendToMd('\n');
 
+  auto alt = c->ExtractAttribute(kAttributeAlt);
+  auto src = c->ExtractAttribute(kAttributeSrc);
+
   c->appendToMd("![")
-      ->appendToMd(c->ExtractAttributeFromTagLeftOf(kAttributeAlt))
+      ->appendToMd(alt.data, alt.size)
       ->appendToMd("](")
-      ->appendToMd(c->ExtractAttributeFromTagLeftOf(kAttributeSrc));
+      ->appendToMd(src.data, src.size);
 
-  auto title = c->ExtractAttributeFromTagLeftOf(kAttributeTitle);
-  if (!title.empty()) {
-    c->appendToMd(" \"")->appendToMd(title)->appendToMd('"');
+  auto title = c->ExtractAttribute(kAttributeTitle);
+  if (title.size != 0) {
+    c->appendToMd(" \"")->appendToMd(title.data, title.size)->appendToMd('"');
   }
 
   c->appendToMd(")");
 }
 
-void Converter::TagImage::OnHasLeftClosingTag(Converter *c) {
-  if (c->prev_tag_ == kTagAnchor)
+void Converter::TagImage::OnHasLeftClosingTag(Converter *c) const {
+  if (c->prev_tag_ == TagId::kAnchor)
     c->appendToMd('\n');
 }
 
-void Converter::TagSeperator::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagSeperator::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("\n---\n"); // NOTE: We can make this an option
 }
 
-void Converter::TagSeperator::OnHasLeftClosingTag(Converter *c) {}
+void Converter::TagSeperator::OnHasLeftClosingTag(Converter *c) const {}
+
+void Converter::FormatTable(bool table_closed) {
+  const char *rows = md_.data() + table_start;
+  size_t size = md_.size() - table_start;
+
+  // Format from the spans in md_ into a reused buffer, then put it back
+  formatted_table_.clear();
+
+  if (table_widths_fixed_) {
+    table_formatter_.formatRows(rows, size, &formatted_table_);
+  } else if (table_closed ||
+             (option.tableSampleRows > 0 &&
+              table_rows_ >= static_cast<size_t>(option.tableSampleRows))) {
+    table_formatter_.format(rows, size, &formatted_table_);
+    table_widths_fixed_ = true;
+  } else {
+    return; // Still measuring
+  }
+
+  RollbackTo(table_start);
+  appendToMd(formatted_table_);
 
-void Converter::TagTable::OnHasLeftOpeningTag(Converter *c) {
+  // The formatted rows are final and can be flushed
+  table_start = Mark();
+}
+
+void Converter::TagTable::OnHasLeftOpeningTag(Converter *c) const {
   c->is_in_table_ = true;
+  c->table_rows_ = 0;
+  c->table_widths_fixed_ = false;
   c->appendToMd('\n');
-  c->table_start = c->md_.length(); // Set start AFTER the newline
+  c->table_start = c->Mark(); // Set start AFTER the newline
 }
 
-void Converter::TagTable::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagTable::OnHasLeftClosingTag(Converter *c) const {
+  // table_start is only kept up to date while a table is open
+  if (!c->is_in_table_)
+    return;
+
   c->is_in_table_ = false;
   c->appendToMd('\n');
 
-  if (!c->option.formatTable)
-    return;
-
-  string table = c->md_.substr(c->table_start);
-  table = formatMarkdownTable(table);
-  c->ShortenMarkdown(c->md_.size() - c->table_start);
-  c->appendToMd(table);
+  if (c->option.formatTable)
+    c->FormatTable(true);
 }
 
-void Converter::TagTableRow::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagTableRow::OnHasLeftOpeningTag(Converter *c) const {
   // Don't add newline here - it creates empty rows
   // The newline is added by the closing tag of the previous row
 }
 
-void Converter::TagTableRow::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagTableRow::OnHasLeftClosingTag(Converter *c) const {
   c->UpdatePrevChFromMd();
   
   // Always close the row with a pipe and space, then newline
@@ -1127,11 +1928,18 @@ void Converter::TagTableRow::OnHasLeftClosingTag(Converter *c) {
     c->appendToMd(c->tableLine);
     c->tableLine.clear();
   }
+
+  if (c->is_in_table_ && c->option.formatTable &&
+      c->option.tableSampleRows > 0) {
+    ++c->table_rows_;
+    c->FormatTable(false);
+  }
 }
 
 
-void Converter::TagTableHeader::OnHasLeftOpeningTag(Converter *c) {
-  auto align = c->ExtractAttributeFromTagLeftOf(kAttrinuteAlign);
+void Converter::TagTableHeader::OnHasLeftOpeningTag(Converter *c) const {
+  auto attribute = c->ExtractAttribute(kAttrinuteAlign);
+  string align(attribute.data, attribute.size);
 
   string line = "| ";
 
@@ -1150,47 +1958,134 @@ void Converter::TagTableHeader::OnHasLeftOpeningTag(Converter *c) {
   c->appendToMd("| ");
 }
 
-void Converter::TagTableHeader::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagTableHeader::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd(" ");
 }
 
 
-void Converter::TagTableData::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagTableData::OnHasLeftOpeningTag(Converter *c) const {
   c->appendToMd("| ");
 }
 
 
-void Converter::TagTableData::OnHasLeftClosingTag(Converter *c) {
+void Converter::TagTableData::OnHasLeftClosingTag(Converter *c) const {
   c->appendToMd(" ");
 }
 
 
-void Converter::TagBlockquote::OnHasLeftOpeningTag(Converter *c) {
+void Converter::TagBlockquote::OnHasLeftOpeningTag(Converter *c) const {
   ++c->index_blockquote;
   c->appendToMd("\n");
   c->appendToMd(Repeat("> ", c->index_blockquote));
 }
 
-void Converter::TagBlockquote::OnHasLeftClosingTag(Converter *c) {
-  --c->index_blockquote;
+void Converter::TagBlockquote::OnHasLeftClosingTag(Converter *c) const {
+  // A closing tag without an opening one is ignored
+  if (c->index_blockquote != 0)
+    --c->index_blockquote;
   // Only shorten if a "> " was added (i.e., a newline was processed in the blockquote)
-  if (!c->md_.empty() && c->md_.length() >= 2 &&
-      c->md_.substr(c->md_.length() - 2) == "> ") {
+  if (c->md_.length() >= 2 &&
+      c->md_.compare(c->md_.length() - 2, 2, "> ") == 0) {
     c->ShortenMarkdown(2); // Remove the '> ' only if it exists
   }
 }
 
 void Converter::reset() {
-  md_.clear();
+  index_ch_in_html_ = 0;
+
+  is_closing_tag_ = false;
+  is_in_attribute_value_ = false;
+  skipping_leading_whitespace_ = true;
+  is_in_code_ = false;
+  is_in_list_ = false;
+  is_in_p_ = false;
+  is_in_pre_ = false;
+  is_in_table_ = false;
+  is_in_table_row_ = false;
+  is_in_tag_ = false;
+  is_self_closing_tag_ = false;
+  is_in_ordered_list_ = false;
+
+  index_ol = 0;
+  list_stack_.clear();
+  table_start = 0;
+  table_rows_ = 0;
+  table_widths_fixed_ = false;
+  index_li = 0;
+  index_blockquote = 0;
+
   prev_ch_in_md_ = 0;
   prev_prev_ch_in_md_ = 0;
-  index_ch_in_html_ = 0;
+  prev_ch_in_html_ = 'x';
+
+  offset_lt_ = 0;
+  current_tag_ = TagId::kUnknown;
+  prev_tag_ = TagId::kUnknown;
+  tag_name_size_ = 0;
+  is_tag_name_complete_ = false;
+  last_ch_in_tag_ = 0;
+
+  is_streaming_ = false;
+  tag_buffer_.clear();
+  reference_.clear();
+  attributes_parsed_ = false;
+
+  cleanup_ = CleanupState();
+  flush_at_ = sink_ ? flush_threshold_ : SIZE_MAX;
+
+  // clear() keeps the capacity
+  tableLine.clear();
+  current_href_.clear();
+  current_title_.clear();
+  anchor_opened_ = false;
+  anchor_state_used_ = false;
+  chars_in_curr_line_ = 0;
+  md_.clear();
+  md_look_back_ = SIZE_MAX;
+}
+
+void Converter::reset(const string &html) {
+  html_.assign(html);
+  borrowed_html_ = nullptr;
+  html_size_ = html_.size();
+
+  reset();
+  md_.reserve(html_size_ * 1.2);
+}
+
+void Converter::reset(const char *html, size_t size) {
+  html_.clear();
+  borrowed_html_ = html;
+  html_size_ = size;
+
+  reset();
+  md_.reserve(html_size_ * 1.2);
+}
+
+string Converter::convert(const string &html) {
+  reset(html);
+  return convert();
 }
 
 bool Converter::IsInIgnoredTag() const {
-  if (current_tag_ == kTagTitle && !option.includeTitle)
+  if (current_tag_ == TagId::kTitle && !option.includeTitle)
     return true;
 
-  return IsIgnoredTag(current_tag_);
+  return IsIgnoredTag(current_tag_) ||
+         (tag_name_size_ != 0 && tag_name_[0] == '-');
+}
+
+string Convert(const string &html, bool *ok) {
+  // One converter per thread, its buffers are reused by every call
+  thread_local Converter converter;
+
+  // html outlives the conversion, so there is no need to copy it
+  converter.reset(html.data(), html.size());
+  string md = converter.convert();
+  if (ok != nullptr)
+    *ok = converter.ok();
+
+  converter.reset(nullptr, 0);
+  return md;
 }
 } // namespace html2md
@@ -0,0 +1,526 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// Converter::convertParallel(): the HTML is split into parts that are
+// converted speculatively on their own threads, then joined in order. A part
+// is only used if the state it started with matches the state the previous
+// part ended with; otherwise the previous part's converter simply continues
+// over it. The result is the same as a sequential conversion.
+
+#include "html2md.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+using std::string;
+using std::vector;
+
+namespace {
+// Minimum size of a part of the HTML
+constexpr size_t kMinPartSize = 256 * 1024;
+
+// HTML converted in front of a part to get into the state it starts with
+constexpr size_t kWarmUpSize = 16 * 1024;
+
+// Markdown cleaned up in front of a part of the cleanup
+constexpr size_t kCleanupWarmUpSize = 4 * 1024;
+
+// Markdown in front of a part that has to be the same as in the sequential
+// conversion. Look-backs further than this make the parallel conversion fall
+// back to a sequential one.
+constexpr size_t kContextSize = 256;
+
+// Finds the `<` of top-level block tags: p, h1-h6, table, div and section
+// that are not inside of a list, blockquote, pre or table. Tags end at the
+// first '>' like in the tokenizer.
+class SplitScanner {
+public:
+  SplitScanner(const char *html, size_t size) : html_(html), size_(size) {}
+
+  // First split point at or after min_pos that wasn't returned yet, or the
+  // size of the HTML
+  size_t next(size_t min_pos) {
+    while (pos_ < size_) {
+      const auto *lt =
+          static_cast<const char *>(memchr(html_ + pos_, '<', size_ - pos_));
+      if (!lt)
+        break;
+
+      size_t tag = static_cast<size_t>(lt - html_);
+      bool split = ScanTag(tag);
+
+      if (split && tag >= min_pos)
+        return tag;
+    }
+
+    pos_ = size_;
+    return size_;
+  }
+
+private:
+  // Update the nesting depth, returns true if the tag is a split point
+  bool ScanTag(size_t tag) {
+    size_t pos = tag + 1;
+    bool closing = pos < size_ && html_[pos] == '/';
+    if (closing)
+      ++pos;
+
+    char name[12];
+    size_t name_size = 0;
+    while (pos < size_ && isalnum(static_cast<unsigned char>(html_[pos]))) {
+      if (name_size < sizeof(name))
+        name[name_size] =
+            static_cast<char>(tolower(static_cast<unsigned char>(html_[pos])));
+      ++name_size;
+      ++pos;
+    }
+
+    const auto *gt =
+        static_cast<const char *>(memchr(html_ + pos, '>', size_ - pos));
+    pos_ = gt ? static_cast<size_t>(gt - html_) + 1 : size_;
+
+    if (name_size > sizeof(name))
+      return false;
+
+    string tag_name(name, name_size);
+    bool nests = tag_name == "ul" || tag_name == "ol" ||
+                 tag_name == "blockquote" || tag_name == "pre" ||
+                 tag_name == "table";
+    bool splits = tag_name == "p" || tag_name == "div" ||
+                  tag_name == "section" || tag_name == "table" ||
+                  (name_size == 2 && name[0] == 'h' && name[1] >= '1' &&
+                   name[1] <= '6');
+
+    bool split = !closing && splits && depth_ == 0;
+
+    if (nests) {
+      if (!closing)
+        ++depth_;
+      else if (depth_ != 0)
+        --depth_;
+    }
+
+    return split;
+  }
+
+  const char *html_;
+  size_t size_;
+  size_t pos_ = 0;
+  size_t depth_ = 0;
+};
+
+// Number of lines in [begin, end) that open or close a code block, begin is
+// the start of a line
+size_t CountFences(const char *text, size_t begin, size_t end) {
+  size_t fences = 0;
+
+  for (size_t pos = begin; pos < end;) {
+    if (end - pos >= 3 &&
+        ((text[pos] == '`' && text[pos + 1] == '`' && text[pos + 2] == '`') ||
+         (text[pos] == '~' && text[pos + 1] == '~' && text[pos + 2] == '~')))
+      ++fences;
+
+    const auto *newline =
+        static_cast<const char *>(memchr(text + pos, '\n', end - pos));
+    pos = newline ? static_cast<size_t>(newline - text) + 1 : end;
+  }
+
+  return fences;
+}
+
+// Joins the threads when it goes out of scope
+class ThreadGroup {
+public:
+  template <typename Function> void run(Function function) {
+    threads_.emplace_back(function);
+  }
+
+  ~ThreadGroup() {
+    for (auto &thread : threads_)
+      thread.join();
+  }
+
+private:
+  vector<std::thread> threads_;
+};
+} // namespace
+
+namespace html2md {
+
+bool Converter::ParseState::operator==(const ParseState &other) const {
+  return is_in_attribute_value == other.is_in_attribute_value &&
+         is_in_code == other.is_in_code && is_in_list == other.is_in_list &&
+         is_in_p == other.is_in_p && is_in_pre == other.is_in_pre &&
+         is_in_table == other.is_in_table &&
+         is_in_table_row == other.is_in_table_row &&
+         is_in_tag == other.is_in_tag &&
+         is_self_closing_tag == other.is_self_closing_tag &&
+         is_in_ordered_list == other.is_in_ordered_list &&
+         index_ol == other.index_ol && index_li == other.index_li &&
+         index_blockquote == other.index_blockquote &&
+         chars_in_curr_line == other.chars_in_curr_line &&
+         prev_ch_in_md == other.prev_ch_in_md &&
+         prev_prev_ch_in_md == other.prev_prev_ch_in_md &&
+         current_tag == other.current_tag && list_stack == other.list_stack &&
+         table_line == other.table_line && reference == other.reference;
+}
+
+bool Converter::CleanupState::operator==(const CleanupState &other) const {
+  if (in_code_block != other.in_code_block ||
+      amount_newlines != other.amount_newlines ||
+      has_output != other.has_output ||
+      pending_newlines != other.pending_newlines)
+    return false;
+
+  for (size_t i = 0; i < kSequenceCount; ++i)
+    if (partial_size[i] != other.partial_size[i] ||
+        memcmp(partial[i], other.partial[i], partial_size[i]) != 0)
+      return false;
+
+  return true;
+}
+
+Converter::ParseState Converter::SaveParseState() const {
+  return {is_in_attribute_value_,
+          is_in_code_,
+          is_in_list_,
+          is_in_p_,
+          is_in_pre_,
+          is_in_table_,
+          is_in_table_row_,
+          is_in_tag_,
+          is_self_closing_tag_,
+          is_in_ordered_list_,
+          index_ol,
+          index_li,
+          index_blockquote,
+          chars_in_curr_line_,
+          prev_ch_in_md_,
+          prev_prev_ch_in_md_,
+          current_tag_,
+          list_stack_,
+          tableLine,
+          reference_,
+          current_href_,
+          current_title_};
+}
+
+void Converter::RestoreParseState(const ParseState &state) {
+  is_in_attribute_value_ = state.is_in_attribute_value;
+  is_in_code_ = state.is_in_code;
+  is_in_list_ = state.is_in_list;
+  is_in_p_ = state.is_in_p;
+  is_in_pre_ = state.is_in_pre;
+  is_in_table_ = state.is_in_table;
+  is_in_table_row_ = state.is_in_table_row;
+  is_in_tag_ = state.is_in_tag;
+  is_self_closing_tag_ = state.is_self_closing_tag;
+  is_in_ordered_list_ = state.is_in_ordered_list;
+  index_ol = state.index_ol;
+  index_li = state.index_li;
+  index_blockquote = state.index_blockquote;
+  chars_in_curr_line_ = state.chars_in_curr_line;
+  prev_ch_in_md_ = state.prev_ch_in_md;
+  prev_prev_ch_in_md_ = state.prev_prev_ch_in_md;
+  current_tag_ = state.current_tag;
+  list_stack_ = state.list_stack;
+  tableLine = state.table_line;
+  reference_ = state.reference;
+  current_href_ = state.current_href;
+  current_title_ = state.current_title;
+}
+
+void Converter::PrepareWorker(Converter *worker) const {
+  worker->htmlSymbolConversions_ = htmlSymbolConversions_;
+  worker->decode_character_references_ = decode_character_references_;
+  worker->symbol_trie_dirty_ = true;
+
+  worker->borrowed_html_ = html();
+  worker->html_size_ = html_size_;
+  worker->reset();
+}
+
+string Converter::convertParallel(unsigned threads) {
+  // We already converted
+  if (index_ch_in_html_ == html_size_)
+    return md_;
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+
+  size_t parts = std::min<size_t>(threads, html_size_ / kMinPartSize);
+  if (parts <= 1 || sink_)
+    return convert();
+
+  reset();
+
+  ParseHtmlParallel(parts);
+  FinishMarkdown(parts);
+
+  return md_;
+}
+
+void Converter::ParseHtmlParallel(size_t parts) {
+  // Part i is [starts[i], starts[i + 1]), converted from warm_ups[i] on
+  vector<size_t> starts(1, 0);
+  vector<size_t> warm_ups(1, 0);
+
+  SplitScanner scanner(html(), html_size_);
+  for (size_t i = 1; i < parts; ++i) {
+    size_t target = html_size_ / parts * i;
+    size_t warm_up = scanner.next(target - kWarmUpSize);
+    size_t start = scanner.next(warm_up + kWarmUpSize);
+
+    if (start >= html_size_)
+      break;
+
+    warm_ups.push_back(warm_up);
+    starts.push_back(start);
+  }
+  starts.push_back(html_size_);
+  parts = starts.size() - 1;
+
+  // Part 0 is converted by this instance, the others by workers
+  vector<std::unique_ptr<Converter>> workers(parts);
+  vector<ParseState> states(parts);
+  vector<size_t> marks(parts, 0);
+
+  for (size_t i = 1; i < parts; ++i) {
+    workers[i].reset(new Converter(&option));
+    PrepareWorker(workers[i].get());
+  }
+
+  {
+    ThreadGroup group;
+    for (size_t i = 1; i < parts; ++i) {
+      group.run([&, i] {
+        Converter &worker = *workers[i];
+
+        worker.index_ch_in_html_ = warm_ups[i];
+        worker.ParseHtml(worker.html(), starts[i]);
+
+        states[i] = worker.SaveParseState();
+        marks[i] = worker.md_.size();
+        worker.md_look_back_ = marks[i];
+        worker.anchor_opened_ = false;
+        worker.anchor_state_used_ = false;
+
+        worker.ParseHtml(worker.html(), starts[i + 1]);
+      });
+    }
+
+    ParseHtml(html(), starts[1]);
+  }
+
+  // Join the parts. The Markdown of the current part starts at
+  // current->md_[current_base], which is md_[out_base]. It's only appended to
+  // md_ once the next part is accepted.
+  Converter *current = this;
+  size_t current_base = 0;
+  size_t out_base = 0;
+
+  auto looked_back_too_far = [&] {
+    return current != this && current->md_look_back_ < current_base + 2;
+  };
+
+  // Last bytes of the Markdown converted so far
+  auto context = [&] {
+    if (current == this)
+      return md_.substr(md_.size() - std::min(md_.size(), kContextSize));
+
+    const string &md = current->md_;
+    size_t own = md.size() - current_base;
+    size_t size = std::min(out_base + own, kContextSize);
+
+    string result;
+    if (size > own)
+      result.assign(md_, out_base - (size - own), size - own);
+    result.append(md, md.size() - std::min(size, own), string::npos);
+    return result;
+  };
+
+  for (size_t i = 1; i < parts; ++i) {
+    if (looked_back_too_far())
+      break;
+
+    Converter &worker = *workers[i];
+    const ParseState &state = states[i];
+    size_t mark = marks[i];
+    size_t context_size = std::min(mark, kContextSize);
+
+    bool matches =
+        !state.is_in_tag && state == current->SaveParseState() &&
+        worker.md_look_back_ >= mark - context_size + 2 &&
+        (!worker.anchor_state_used_ ||
+         (state.current_href == current->current_href_ &&
+          state.current_title == current->current_title_));
+
+    if (matches) {
+      string expected = context();
+      matches = expected.size() == context_size &&
+                worker.md_.compare(mark - context_size, context_size,
+                                   expected) == 0;
+    }
+
+    if (!matches) {
+      // Convert the part again after the previous one
+      current->ParseHtml(current->html(), starts[i + 1]);
+      continue;
+    }
+
+    if (current != this) {
+      md_.resize(out_base);
+      md_.append(current->md_, current_base, string::npos);
+    }
+
+    // The anchor of the previous part is still open
+    if (!worker.anchor_opened_ && !worker.anchor_state_used_) {
+      worker.current_href_ = current->current_href_;
+      worker.current_title_ = current->current_title_;
+    }
+
+    current = &worker;
+    current_base = mark - context_size;
+    out_base = md_.size() - context_size;
+  }
+
+  if (looked_back_too_far()) {
+    // A part changed Markdown in front of it that is not known to be the same
+    // as in the sequential conversion
+    reset();
+    ParseHtml(html(), html_size_);
+    return;
+  }
+
+  if (current != this) {
+    md_.resize(out_base);
+    md_.append(current->md_, current_base, string::npos);
+    RestoreParseState(current->SaveParseState());
+  }
+
+  index_ch_in_html_ = html_size_;
+}
+
+void Converter::CleanUpMarkdownParallel(size_t parts) {
+  const char *markdown = md_.data();
+  size_t size = md_.size();
+
+  // Part i is the lines in [starts[i], starts[i + 1])
+  vector<size_t> starts(1, 0);
+  for (size_t i = 1; i < parts; ++i) {
+    size_t target = std::max(size / parts * i, starts.back());
+    const auto *newline = static_cast<const char *>(
+        memchr(markdown + target, '\n', size - target));
+
+    if (!newline || static_cast<size_t>(newline - markdown) + 1 >= size)
+      break;
+
+    starts.push_back(static_cast<size_t>(newline - markdown) + 1);
+  }
+  starts.push_back(size);
+  parts = starts.size() - 1;
+
+  if (parts == 1) {
+    CleanUpMarkdown();
+    return;
+  }
+
+  // Each part is cleaned up after a few lines in front of it, starting at
+  // warm_ups[i]
+  vector<size_t> warm_ups(parts, 0);
+  for (size_t i = 1; i < parts; ++i) {
+    size_t from = starts[i] - std::min(starts[i], kCleanupWarmUpSize);
+    if (from != 0) {
+      const auto *newline = static_cast<const char *>(
+          memchr(markdown + from, '\n', starts[i] - from));
+      from = static_cast<size_t>(newline - markdown) + 1;
+    }
+    warm_ups[i] = from;
+  }
+
+  // Whether a line is in a code block depends on all fences in front of it,
+  // so they are counted first
+  vector<size_t> fences(parts);
+  {
+    ThreadGroup group;
+    for (size_t i = 1; i < parts; ++i)
+      group.run([&, i] {
+        fences[i] = CountFences(markdown, starts[i], starts[i + 1]);
+      });
+
+    fences[0] = CountFences(markdown, 0, starts[1]);
+  }
+
+  vector<bool> in_code_block(parts, false);
+  size_t fences_in_front = fences[0];
+  for (size_t i = 1; i < parts; ++i) {
+    size_t warm_up_fences = CountFences(markdown, warm_ups[i], starts[i]);
+    in_code_block[i] = (fences_in_front - warm_up_fences) % 2 != 0;
+    fences_in_front += fences[i];
+  }
+
+  vector<std::unique_ptr<Converter>> workers(parts);
+  vector<CleanupState> states(parts);
+  vector<string> cleaned(parts);
+
+  for (size_t i = 1; i < parts; ++i) {
+    workers[i].reset(new Converter(&option));
+    PrepareWorker(workers[i].get());
+  }
+
+  {
+    ThreadGroup group;
+    for (size_t i = 1; i < parts; ++i) {
+      group.run([&, i] {
+        Converter &worker = *workers[i];
+
+        string discarded;
+        worker.cleanup_.in_code_block = in_code_block[i];
+        worker.CleanUp(markdown + warm_ups[i], starts[i] - warm_ups[i], false,
+                       &discarded);
+        states[i] = worker.cleanup_;
+
+        worker.CleanUp(markdown + starts[i], starts[i + 1] - starts[i], false,
+                       &cleaned[i]);
+      });
+    }
+
+    cleanup_ = CleanupState();
+    CleanUp(markdown, starts[1], false, &cleaned[0]);
+  }
+
+  // Accept a part if it started with the state the previous one ended with,
+  // otherwise clean it up again after the previous one
+  Converter *current = this;
+  size_t current_part = 0;
+
+  for (size_t i = 1; i < parts; ++i) {
+    if (states[i] == current->cleanup_) {
+      current = workers[i].get();
+      current_part = i;
+    } else {
+      cleaned[i].clear();
+      current->CleanUp(markdown + starts[i], starts[i + 1] - starts[i], false,
+                       &cleaned[current_part]);
+    }
+  }
+
+  current->CleanUp(markdown + size, 0, true, &cleaned[current_part]);
+  cleanup_ = current->cleanup_;
+
+  size_t cleaned_size = 0;
+  for (const auto &part : cleaned)
+    cleaned_size += part.size();
+
+  cleanup_buffer_.clear();
+  cleanup_buffer_.reserve(cleaned_size);
+  for (const auto &part : cleaned)
+    cleanup_buffer_ += part;
+
+  md_.swap(cleanup_buffer_);
+}
+
+} // namespace html2md
@@ -0,0 +1,56 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace html2md {
+
+void OstreamSink::write(const char *data, size_t size) {
+  stream_.write(data, static_cast<std::streamsize>(size));
+}
+
+void FdSink::write(const char *data, size_t size) {
+  while (ok_ && size > 0) {
+#ifdef _WIN32
+    auto written = ::_write(
+        fd_, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+    auto written = ::write(fd_, data, size);
+#endif
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+
+      ok_ = false;
+      return;
+    }
+
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+
+void BufferSink::write(const char *data, size_t size) {
+  size_t fits = std::min(size, capacity_ - size_);
+
+  if (fits != 0) {
+    memcpy(buffer_ + size_, data, fits);
+    size_ += fits;
+  }
+
+  if (fits != size)
+    overflowed_ = true;
+}
+
+} // namespace html2md
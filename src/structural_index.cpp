@@ -0,0 +1,190 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#include "structural_index.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HTML2MD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define HTML2MD_AVX2 1
+#include <immintrin.h>
+#elif defined(HTML2MD_SSE2) && (defined(__GNUC__) || defined(__clang__)) &&   \
+    (defined(__x86_64__) || defined(__i386__))
+// Compiled for a baseline target: build the AVX2 kernel anyway and pick it at
+// runtime if the CPU supports it.
+#define HTML2MD_AVX2 1
+#define HTML2MD_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+constexpr size_t kBlockSize = 64;
+
+constexpr char kStructural[] = {'<', '>', '"', '\'', '&',
+                                '\n', '*', '`', '\\', '.'};
+constexpr char kWhitespace[] = {' ', '\t'};
+
+inline unsigned CountTrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+#ifdef _M_X64
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  if (_BitScanForward(&index, static_cast<unsigned long>(mask)))
+    return index;
+  _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+  return index + 32;
+#endif
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+#ifndef HTML2MD_SSE2
+uint64_t ScalarMask(const char *block, bool whitespace) {
+  uint64_t mask = 0;
+
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    char ch = block[i];
+    bool hit = memchr(kStructural, ch, sizeof(kStructural)) != nullptr ||
+               (whitespace && (ch == ' ' || ch == '\t'));
+    mask |= static_cast<uint64_t>(hit) << i;
+  }
+
+  return mask;
+}
+#else
+inline __m128i MatchSse2(__m128i chunk, bool whitespace) {
+  __m128i hits = _mm_setzero_si128();
+
+  for (char ch : kStructural)
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(ch)));
+
+  if (whitespace)
+    for (char ch : kWhitespace)
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(ch)));
+
+  return hits;
+}
+
+uint64_t Sse2Mask(const char *block, bool whitespace) {
+  uint64_t mask = 0;
+
+  for (size_t i = 0; i < kBlockSize; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+    auto bits = static_cast<uint32_t>(
+        _mm_movemask_epi8(MatchSse2(chunk, whitespace)));
+    mask |= static_cast<uint64_t>(bits) << i;
+  }
+
+  return mask;
+}
+#endif
+
+#ifdef HTML2MD_AVX2
+#ifdef HTML2MD_AVX2_DISPATCH
+#define HTML2MD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HTML2MD_TARGET_AVX2
+#endif
+
+HTML2MD_TARGET_AVX2 uint64_t Avx2Mask(const char *block, bool whitespace) {
+  uint64_t mask = 0;
+
+  for (size_t i = 0; i < kBlockSize; i += 32) {
+    __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + i));
+    __m256i hits = _mm256_setzero_si256();
+
+    for (char ch : kStructural)
+      hits = _mm256_or_si256(hits,
+                             _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(ch)));
+
+    if (whitespace)
+      for (char ch : kWhitespace)
+        hits = _mm256_or_si256(
+            hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(ch)));
+
+    auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+    mask |= static_cast<uint64_t>(bits) << i;
+  }
+
+  return mask;
+}
+#endif
+
+using MaskKernel = uint64_t (*)(const char *, bool);
+
+MaskKernel SelectKernel() {
+#if defined(HTML2MD_AVX2) && !defined(HTML2MD_AVX2_DISPATCH)
+  return &Avx2Mask;
+#else
+#ifdef HTML2MD_AVX2_DISPATCH
+  if (__builtin_cpu_supports("avx2"))
+    return &Avx2Mask;
+#endif
+#ifdef HTML2MD_SSE2
+  return &Sse2Mask;
+#else
+  return &ScalarMask;
+#endif
+#endif
+}
+
+const MaskKernel kMaskKernel = SelectKernel();
+} // namespace
+
+namespace html2md {
+
+StructuralIndex::StructuralIndex(const char *data, size_t size,
+                                 bool whitespace)
+    : data_(data), size_(size), whitespace_(whitespace) {}
+
+uint64_t StructuralIndex::BlockMask(size_t block_start) const {
+  if (block_start + kBlockSize <= size_)
+    return kMaskKernel(data_ + block_start, whitespace_);
+
+  // Pad the tail with NUL, which is never structural
+  char tail[kBlockSize] = {};
+  memcpy(tail, data_ + block_start, size_ - block_start);
+  return kMaskKernel(tail, whitespace_);
+}
+
+size_t StructuralIndex::next(size_t pos) {
+  if (pos >= size_)
+    return size_;
+
+  size_t block = pos & ~(kBlockSize - 1);
+  if (block != block_) {
+    block_ = block;
+    mask_ = BlockMask(block_);
+  }
+
+  // Ignore everything in front of pos
+  uint64_t mask = mask_ & (~uint64_t(0) << (pos - block_));
+
+  while (mask == 0) {
+    block_ += kBlockSize;
+    if (block_ >= size_)
+      return size_;
+
+    mask_ = BlockMask(block_);
+    mask = mask_;
+  }
+
+  return block_ + CountTrailingZeros(mask);
+}
+
+} // namespace html2md
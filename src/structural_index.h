@@ -0,0 +1,55 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+#ifndef STRUCTURAL_INDEX_H
+#define STRUCTURAL_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace html2md {
+
+/*!
+ * \brief Locates the characters the tokenizer has to look at one by one
+ *
+ * Stage one of the conversion: the input is classified in blocks of 64 bytes
+ * into a bitmap of structural positions (`<`, `>`, `"`, `'`, `&`, `\n` and the
+ * Markdown specials `*`, `` ` ``, `\`, `.`). Everything between two structural
+ * positions is plain text that Converter::convert() appends in one go.
+ *
+ * The bitmap is built lazily, one block at a time, so the index needs no memory
+ * proportional to the input. SSE2 and AVX2 kernels are used when available.
+ */
+class StructuralIndex {
+public:
+  /*!
+   * \param data The input
+   * \param size Length of the input
+   * \param whitespace Also treat ' ' and '\\t' as structural (needed when
+   * whitespace gets compressed)
+   */
+  StructuralIndex(const char *data, size_t size, bool whitespace);
+
+  /*!
+   * \brief Find the next structural position
+   * \param pos Offset to start searching at
+   * \return The offset of the first structural character at or after `pos`, or
+   * the input size if there is none.
+   */
+  size_t next(size_t pos);
+
+private:
+  uint64_t BlockMask(size_t block_start) const;
+
+  const char *data_;
+  size_t size_;
+  bool whitespace_;
+
+  // Currently classified block and its bitmap
+  size_t block_ = SIZE_MAX;
+  uint64_t mask_ = 0;
+};
+
+} // namespace html2md
+
+#endif // STRUCTURAL_INDEX_H
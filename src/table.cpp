@@ -3,104 +3,169 @@
 
 #include "table.h"
 
-#include <iomanip>
-#include <iostream>
-#include <sstream>
-#include <vector>
+#include <algorithm>
+#include <cstring>
 
 using std::string;
-using std::vector;
 
+namespace {
 const size_t MIN_LINE_LENGTH = 3; // Minimum length of line
 
-void removeLeadingTrailingSpaces(string &str) {
-  size_t firstNonSpace = str.find_first_not_of(' ');
-  if (firstNonSpace == string::npos) {
-    str.clear(); // Entire string is spaces
-    return;
-  }
-
-  size_t lastNonSpace = str.find_last_not_of(' ');
-  str = str.substr(firstNonSpace, lastNonSpace - firstNonSpace + 1);
+// Position of the next ch in [pos, end), or end
+inline size_t Find(const char *text, size_t pos, size_t end, char ch) {
+  auto found = static_cast<const char *>(memchr(text + pos, ch, end - pos));
+  return found ? static_cast<size_t>(found - text) : end;
 }
 
-string enlargeTableHeaderLine(const string &str, size_t length) {
-  if (str.empty() || length < MIN_LINE_LENGTH)
-    return "";
+// End of the cell starting at pos: the next '|' that isn't escaped, or end
+size_t FindCellEnd(const char *text, size_t pos, size_t end) {
+  for (size_t found = Find(text, pos, end, '|'); found != end;
+       found = Find(text, found + 1, end, '|')) {
+    size_t backslashes = 0;
+    while (found - backslashes > pos && text[found - backslashes - 1] == '\\')
+      ++backslashes;
+
+    if (backslashes % 2 == 0)
+      return found;
+  }
 
-  size_t first = str.find_first_of(':');
-  size_t last = str.find_last_of(':');
+  return end;
+}
 
-  if (first == 0 && first == last)
-    last = string::npos;
+// Number of characters, UTF-8 continuation bytes don't count
+size_t Width(const char *text, size_t size) {
+  size_t width = 0;
+  for (size_t i = 0; i < size; ++i)
+    if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80)
+      ++width;
+  return width;
+}
+} // namespace
 
-  string line = string(length, '-');
+namespace html2md {
 
-  if (first == 0)
-    line[0] = ':';
-  if (last == str.length() - 1)
-    line[length - 1] = ':';
+void TableFormatter::Split(const char *table, size_t size, bool measure) {
+  cells_.clear();
+  row_ends_.clear();
 
-  return line;
+  for (size_t pos = 0; pos < size;) {
+    size_t line_end = Find(table, pos, size, '\n');
+    AddRow(table, pos, line_end, measure);
+    pos = line_end + 1;
+  }
 }
 
-string formatMarkdownTable(const string &inputTable) {
-  std::istringstream iss(inputTable);
-  string line;
-  vector<vector<string>> tableData;
-
-  // Parse the input table into a 2D vector
-  while (std::getline(iss, line)) {
-    std::istringstream lineStream(line);
-    string cell;
-    vector<string> rowData;
-
-    while (std::getline(lineStream, cell, '|')) {
-      removeLeadingTrailingSpaces(cell); // Trim first
-      if (!cell.empty()) { // Then check if empty
-        rowData.push_back(cell);
+void TableFormatter::AddRow(const char *table, size_t begin, size_t end,
+                            bool measure) {
+  size_t column = 0;
+
+  for (size_t pos = begin; pos <= end;) {
+    size_t cell_end = FindCellEnd(table, pos, end);
+
+    // Trim the spaces around the content
+    size_t first = pos;
+    size_t last = cell_end;
+    while (first < last && table[first] == ' ')
+      ++first;
+    while (last > first && table[last - 1] == ' ')
+      --last;
+
+    if (first != last) {
+      size_t width = Width(table + first, last - first);
+      cells_.push_back({first, last - first, width});
+
+      if (measure) {
+        if (widths_.size() == column)
+          widths_.push_back(0);
+        widths_[column] = std::max(widths_[column], width);
       }
+      ++column;
     }
 
-    if (!rowData.empty()) {
-      tableData.push_back(std::move(rowData)); // Move rowData to avoid copying
-    }
-  }
-
-  if (tableData.empty()) { 
-    return ""; 
+    pos = cell_end + 1;
   }
 
-  // Determine maximum width of each column
-  vector<size_t> columnWidths(tableData[0].size(), 0);
-  for (const auto &row : tableData) {
-    if (columnWidths.size() < row.size()) {
-      columnWidths.resize(row.size(), 0);
-    }
+  if (column != 0)
+    row_ends_.push_back(cells_.size());
+}
 
-    for (size_t i = 0; i < row.size(); ++i) {
-      columnWidths[i] = std::max(columnWidths[i], row[i].size());
-    }
-  }
+void TableFormatter::AppendSeparator(const char *cell, size_t cell_size,
+                                     size_t width, string *out) const {
+  size_t length = width + 2;
+  if (length < MIN_LINE_LENGTH)
+    return;
 
-  // Build the formatted table
-  std::ostringstream formattedTable;
-  for (size_t rowNumber = 0; rowNumber < tableData.size(); ++rowNumber) {
-    const auto &row = tableData[rowNumber];
+  // A colon at the start aligns left, one at the end right. A lone colon at
+  // the start only counts once.
+  bool left = cell[0] == ':';
+  bool right = cell[cell_size - 1] == ':' && (cell_size != 1 || !left);
 
-    formattedTable << "|";
+  out->push_back(left ? ':' : '-');
+  out->append(length - 2, '-');
+  out->push_back(right ? ':' : '-');
+}
 
-    for (size_t i = 0; i < row.size(); ++i) {
-      if (rowNumber == 1) {
-        formattedTable << enlargeTableHeaderLine(row[i], columnWidths[i] + 2)
-                       << "|";
+void TableFormatter::WriteRows(const char *table, string *out) {
+  // Reserve all rows up front so they are written without reallocation
+  size_t formatted_size = 0;
+  size_t row_begin = 0;
+  for (size_t row_end : row_ends_) {
+    formatted_size += 2; // Leading '|' and '\n'
+    for (size_t i = row_begin; i < row_end; ++i)
+      formatted_size += cells_[i].size + 3;
+    for (size_t i = 0; i < row_end - row_begin && i < widths_.size(); ++i)
+      formatted_size += widths_[i];
+    row_begin = row_end;
+  }
+  out->reserve(out->size() + formatted_size);
+
+  row_begin = 0;
+  for (size_t row_end : row_ends_) {
+    out->push_back('|');
+
+    for (size_t i = row_begin; i < row_end; ++i) {
+      const Cell &cell = cells_[i];
+      size_t column = i - row_begin;
+      size_t width = column < widths_.size()
+                         ? std::max(widths_[column], cell.width)
+                         : cell.width;
+
+      if (rows_written_ == 1) {
+        AppendSeparator(table + cell.offset, cell.size, width, out);
+        out->push_back('|');
         continue;
       }
-      formattedTable << " " << std::setw(columnWidths[i]) << std::left << row[i]
-                     << " |";
+
+      out->push_back(' ');
+      out->append(table + cell.offset, cell.size);
+      out->append(width - cell.width + 1, ' ');
+      out->push_back('|');
     }
-    formattedTable << "\n";
+
+    out->push_back('\n');
+    row_begin = row_end;
+    ++rows_written_;
   }
+}
 
-  return formattedTable.str();
+void TableFormatter::format(const char *table, size_t size, string *out) {
+  widths_.clear();
+  rows_written_ = 0;
+
+  Split(table, size, true);
+  WriteRows(table, out);
+}
+
+void TableFormatter::formatRows(const char *rows, size_t size, string *out) {
+  Split(rows, size, false);
+  WriteRows(rows, out);
+}
+
+} // namespace html2md
+
+string formatMarkdownTable(const string &inputTable) {
+  html2md::TableFormatter formatter;
+  string formatted;
+  formatter.format(inputTable.data(), inputTable.size(), &formatted);
+  return formatted;
 }
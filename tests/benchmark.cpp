@@ -7,8 +7,10 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "batch_converter.h"
 #include "html2md.h"
 #include "md4c-html.h"
 #include "table.h"
@@ -142,6 +144,261 @@ private:
   }
 };
 
+// Time constructing a Converter from a copied std::string against borrowing
+// the same buffer, which is what the zero-copy initializers avoid
+void runInputBenchmark(const string &html, int iterations) {
+  auto measure = [&](bool borrow) {
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      if (borrow) {
+        html2md::Converter c(html.data(), html.size());
+      } else {
+        html2md::Converter c(html);
+      }
+    }
+    auto end = high_resolution_clock::now();
+    return duration<double, std::micro>(end - start).count() / iterations;
+  };
+
+  double copy_us = measure(false);
+  double borrow_us = measure(true);
+
+  cout << "\n=== Input Ownership (" << html.size() << " B) ===\n";
+  cout << std::left << std::setw(30) << "Initializer" << std::setw(15)
+       << "Avg Time (us)\n";
+  cout << std::string(45, '-') << "\n";
+  cout << std::left << std::setw(30) << "std::string (copy)" << std::fixed
+       << std::setprecision(2) << copy_us << "\n";
+  cout << std::left << std::setw(30) << "const char*, size_t (borrow)"
+       << std::fixed << std::setprecision(2) << borrow_us << "\n";
+}
+
+// Cost per input character for text-heavy documents, the hot path of the
+// tokenizer
+void runPerCharacterBenchmark(int iterations) {
+  const string sentence =
+      "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do "
+      "eiusmod tempor incididunt ut labore et dolore magna aliqua. ";
+
+  string plain, inline_tags, links;
+  for (int i = 0; i < 2000; ++i) {
+    plain += "<p>" + sentence + "</p>\n";
+    inline_tags += "<p><b>" + sentence + "</b> <em>" + sentence + "</em></p>\n";
+    links += "<a href=\"https://example.com/\">" + sentence + "</a>\n";
+  }
+
+  html2md::Options options;
+  options.splitLines = false;
+
+  cout << "\n=== Per Character Cost ===\n";
+  cout << std::left << std::setw(30) << "Input" << std::setw(15)
+       << "ns/char\n";
+  cout << std::string(45, '-') << "\n";
+
+  for (const auto &input : {std::make_pair("paragraphs", &plain),
+                            std::make_pair("inline tags", &inline_tags),
+                            std::make_pair("links", &links)}) {
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      html2md::Converter c(*input.second, &options);
+      auto md = c.convert();
+    }
+    auto end = high_resolution_clock::now();
+
+    double ns = duration<double, std::nano>(end - start).count() /
+                iterations / input.second->size();
+    cout << std::left << std::setw(30) << input.first << std::fixed
+         << std::setprecision(2) << ns << "\n";
+  }
+}
+
+// Output with many places the cleanup has to fix (" , " and a lone "." on a
+// line), each of them used to copy the rest of the Markdown
+void runCleanupBenchmark(int iterations) {
+  const int units = 20000; // 3 fix-ups each
+
+  string html;
+  for (int i = 0; i < units; ++i)
+    html += "<p>lorem , ipsum , dolor</p>.";
+
+  html2md::Options options;
+  options.splitLines = false;
+
+  auto start = high_resolution_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    html2md::Converter c(html, &options);
+    auto md = c.convert();
+  }
+  auto end = high_resolution_clock::now();
+
+  double ms = duration<double, std::milli>(end - start).count() / iterations;
+
+  cout << "\n=== Cleanup ===\n";
+  cout << units * 3 << " fix-ups: " << std::fixed << std::setprecision(2) << ms
+       << " ms per conversion\n";
+}
+
+void runTableBenchmark(int iterations) {
+  const int rows = 5000;
+
+  string html = "<table><tr><th>Name</th><th>Value</th><th>Share</th></tr>";
+  for (int i = 0; i < rows; ++i)
+    html += "<tr><td>row " + std::to_string(i) + "</td><td>" +
+            std::to_string(i * 37) + "</td><td>0." + std::to_string(i % 100) +
+            "</td></tr>";
+  html += "</table>";
+
+  auto start = high_resolution_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    html2md::Converter c(html);
+    auto md = c.convert();
+  }
+  auto end = high_resolution_clock::now();
+
+  double ms = duration<double, std::milli>(end - start).count() / iterations;
+
+  cout << "\n=== Table ===\n";
+  cout << rows << " rows: " << std::fixed << std::setprecision(2) << ms
+       << " ms per conversion\n";
+}
+
+// Inputs that remove output again and again (empty links, closing lists and
+// blockquotes). The time per element has to stay the same when the document
+// grows.
+void runRollbackBenchmark() {
+  const std::pair<const char *, const char *> inputs[] = {
+      {"empty links", "<p>x <a href=\"#\"></a></p>"},
+      {"list closes", "<ul><li><p>x</p></li></ul>"},
+      {"blockquotes", "<blockquote>x\n</blockquote>"},
+  };
+
+  cout << "\n=== Rollback Scaling (ns/element) ===\n";
+  cout << std::left << std::setw(20) << "Input";
+  for (int elements = 5000; elements <= 40000; elements *= 2)
+    cout << std::setw(12) << elements;
+  cout << "\n" << std::string(68, '-') << "\n";
+
+  for (const auto &input : inputs) {
+    cout << std::left << std::setw(20) << input.first;
+
+    for (int elements = 5000; elements <= 40000; elements *= 2) {
+      string html;
+      for (int i = 0; i < elements; ++i)
+        html += input.second;
+
+      auto start = high_resolution_clock::now();
+      html2md::Converter c(html);
+      auto md = c.convert();
+      auto end = high_resolution_clock::now();
+
+      double ns = duration<double, std::nano>(end - start).count() / elements;
+      cout << std::setw(12) << std::fixed << std::setprecision(1) << ns;
+    }
+
+    cout << "\n";
+  }
+}
+
+// Throughput from 1 KiB up to max_size. The Markdown goes to a sink that only
+// counts it, so memory use is the input alone. Deep nesting is included to
+// make sure the counters don't wrap.
+void runScalingBenchmark(size_t max_size) {
+  string unit = "<h2>Section</h2><p>Some <b>bold</b>, <i>italic</i> and "
+                "<a href=\"https://example.com/\" title=\"t\">linked</a> "
+                "text &amp; &mdash; more.</p><ul><li>one</li><li>two<ol><li>"
+                "three</li></ol></li></ul><table><tr><th>A</th><th>B</th></tr>"
+                "<tr><td>1</td><td>2</td></tr></table><pre><code>code\n"
+                "</code></pre>";
+  for (int i = 0; i < 300; ++i)
+    unit += "<ol><li>deep";
+  for (int i = 0; i < 300; ++i)
+    unit += "</li></ol>";
+
+  string html;
+  html.reserve(max_size + unit.size());
+
+  cout << "\n=== Scaling ===\n";
+  cout << std::left << std::setw(15) << "Input" << std::setw(15) << "Time (ms)"
+       << "MB/s\n";
+  cout << std::string(45, '-') << "\n";
+
+  for (size_t size = 1024; size <= max_size; size *= 32) {
+    while (html.size() < size)
+      html += unit;
+
+    size_t written = 0;
+    html2md::CallbackSink sink(
+        [&](const char *, size_t part) { written += part; });
+
+    auto start = high_resolution_clock::now();
+    html2md::Converter c(html.data(), html.size());
+    c.setSink(&sink);
+    auto md = c.convert();
+    auto end = high_resolution_clock::now();
+
+    double ms = duration<double, std::milli>(end - start).count();
+    string label = size >= (1 << 20) ? std::to_string(size >> 20) + " MiB"
+                                     : std::to_string(size >> 10) + " KiB";
+    cout << std::left << std::setw(15) << label << std::setw(15) << std::fixed
+         << std::setprecision(2) << ms << html.size() / ms / 1000.0 << "\n";
+  }
+}
+
+// Pages per second with BatchConverter. Every 100th page is a thousand times
+// larger than the others, the other workers have to keep going meanwhile.
+void runBatchBenchmark(const vector<string> &pages_in) {
+  if (pages_in.empty())
+    return;
+
+  vector<string> pages;
+  for (size_t i = 0; i < 2000; ++i) {
+    pages.push_back(pages_in[i % pages_in.size()]);
+    if (i % 100 == 0)
+      for (int j = 0; j < 1000; ++j)
+        pages.back() += "<p>filler <b>text</b></p>";
+  }
+
+  cout << "\n=== Batch (" << pages.size() << " pages) ===\n";
+  cout << std::left << std::setw(15) << "Threads" << std::setw(15)
+       << "Time (ms)" << "Pages/s\n";
+  cout << std::string(45, '-') << "\n";
+
+  unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    html2md::BatchConverter batch(threads);
+
+    auto start = high_resolution_clock::now();
+    auto md = batch.convert(pages);
+    auto end = high_resolution_clock::now();
+
+    double ms = duration<double, std::milli>(end - start).count();
+    cout << std::left << std::setw(15) << threads << std::setw(15) << std::fixed
+         << std::setprecision(2) << ms << pages.size() / ms * 1000.0 << "\n";
+  }
+}
+
+void runParallelBenchmark(const string &html, int iterations) {
+  cout << "\n=== Parallel conversion (" << html.size() / (1024 * 1024)
+       << " MiB) ===\n";
+  cout << std::left << std::setw(15) << "Threads" << std::setw(15)
+       << "Time (ms)" << "MB/s\n";
+  cout << std::string(45, '-') << "\n";
+
+  unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    auto start = high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      html2md::Converter converter(html.data(), html.size());
+      auto md = converter.convertParallel(threads);
+    }
+    auto end = high_resolution_clock::now();
+
+    double ms = duration<double, std::milli>(end - start).count() / iterations;
+    cout << std::left << std::setw(15) << threads << std::setw(15) << std::fixed
+         << std::setprecision(2) << ms << html.size() / ms / 1000.0 << "\n";
+  }
+}
+
 namespace file {
 string readAll(const string &name) {
   ifstream in(name);
@@ -168,11 +425,13 @@ int main() {
   }
   std::sort(files.begin(), files.end());
 
+  vector<string> runner_inputs;
   for (const auto &file : files) {
     string md = file::readAll(file);
     string html = markdown::toHTML(md);
     string filename = fs::path(file).filename().string();
     runner.addTest(filename, html, false);
+    runner_inputs.push_back(html);
   }
 
   // Run benchmarks
@@ -180,5 +439,26 @@ int main() {
        << " iterations per test...\n";
   runner.run(iterations);
 
+  // Build a multi-megabyte document out of the test files
+  string large_html;
+  while (!runner_inputs.empty() && large_html.size() < 8 * 1024 * 1024)
+    for (const auto &html : runner_inputs)
+      large_html += html;
+  runInputBenchmark(large_html, 100);
+
+  runPerCharacterBenchmark(20);
+
+  runCleanupBenchmark(10);
+
+  runRollbackBenchmark();
+
+  runTableBenchmark(10);
+
+  runScalingBenchmark(size_t(1) << 30);
+
+  runBatchBenchmark(runner_inputs);
+
+  runParallelBenchmark(large_html, 10);
+
   return 0;
 }
\ No newline at end of file
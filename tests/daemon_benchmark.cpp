@@ -0,0 +1,169 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// Load generator for the daemon mode (html2md --serve). Every connection
+// sends its requests one after another and the latency of each one is
+// recorded.
+//
+//   daemon-benchmark [socket [connections [requests]]]
+//
+// Without a socket, a daemon is started in this process on a temporary one.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "daemon.h"
+#include "html2md.h"
+#include "md4c-html.h"
+
+using std::cout;
+using std::string;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+namespace {
+void captureHtmlFragment(const MD_CHAR *data, const MD_SIZE data_size,
+                         void *userData) {
+  static_cast<string *>(userData)->append(data, data_size);
+}
+
+// The Markdown files of the tests, as HTML
+vector<string> loadDocuments() {
+  vector<string> documents;
+
+  for (const auto &p : fs::directory_iterator(DIR)) {
+    if (p.path().extension() != ".md")
+      continue;
+
+    std::ifstream in(p.path());
+    std::stringstream md;
+    md << in.rdbuf();
+
+    string html;
+    static MD_TOC_OPTIONS options;
+    md_html(md.str().c_str(), static_cast<MD_SIZE>(md.str().size()),
+            &captureHtmlFragment, &html, MD_DIALECT_GITHUB,
+            MD_HTML_FLAG_SKIP_UTF8_BOM, &options);
+    documents.push_back(html);
+  }
+
+  return documents;
+}
+
+double percentile(const vector<double> &sorted, double p) {
+  size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size()));
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  string path = argc > 1 ? argv[1] : "";
+  unsigned connections =
+      argc > 2 ? static_cast<unsigned>(std::atoi(argv[2]))
+               : std::max(4u, 2 * std::thread::hardware_concurrency());
+  int requests = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+  const vector<string> documents = loadDocuments();
+  if (documents.empty() || connections == 0 || requests <= 0)
+    return 1;
+
+  // Start a daemon unless one was given
+  std::unique_ptr<Daemon::Protocol> protocol;
+  std::unique_ptr<Server::Server> server;
+  std::thread serving;
+  if (path.empty()) {
+    path = (fs::temp_directory_path() /
+            ("html2md-benchmark-" + std::to_string(getpid()) + ".sock"))
+               .string();
+
+    string error;
+    int fd = Daemon::listen(path, &error);
+    if (fd < 0) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+
+    protocol.reset(new Daemon::Protocol(Daemon::Options().maxRequestSize));
+    server.reset(new Server::Server(fd, protocol.get(), 0, {}));
+    serving = std::thread([&] { server->run(); });
+  }
+
+  vector<vector<double>> latencies(connections);
+  std::atomic<int> failures{0};
+
+  auto start = steady_clock::now();
+
+  vector<std::thread> clients;
+  for (unsigned c = 0; c < connections; ++c)
+    clients.emplace_back([&, c] {
+      try {
+        Daemon::Client client(path);
+
+        for (int i = 0; i < requests; ++i) {
+          const string &html = documents[(c + i) % documents.size()];
+
+          auto sent = steady_clock::now();
+          string md = client.convert(html.data(), html.size());
+          auto received = steady_clock::now();
+
+          latencies[c].push_back(
+              duration<double, std::micro>(received - sent).count());
+
+          // Spot-check the results, like the tests
+          if (i < static_cast<int>(documents.size()) &&
+              md != html2md::Convert(html))
+            ++failures;
+        }
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        ++failures;
+      }
+    });
+
+  for (auto &client : clients)
+    client.join();
+
+  double seconds = duration<double>(steady_clock::now() - start).count();
+
+  if (server) {
+    server->stop();
+    serving.join();
+    ::unlink(path.c_str());
+  }
+
+  vector<double> all;
+  for (const auto &connection : latencies)
+    all.insert(all.end(), connection.begin(), connection.end());
+  std::sort(all.begin(), all.end());
+
+  if (all.empty())
+    return 1;
+
+  cout << "=== Daemon (" << connections << " connections, " << all.size()
+       << " requests) ===\n";
+  cout << std::fixed << std::setprecision(1);
+  cout << "Requests/s: " << static_cast<double>(all.size()) / seconds << "\n";
+  cout << "p50: " << percentile(all, 0.50) << " us\n";
+  cout << "p90: " << percentile(all, 0.90) << " us\n";
+  cout << "p99: " << percentile(all, 0.99) << " us\n";
+  cout << "max: " << all.back() << " us\n";
+
+  if (failures != 0)
+    cout << failures << " requests failed or returned wrong Markdown\n";
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// Load generator for the HTTP mode (html2md --http). Every connection is
+// kept alive and sends `pipeline` requests at a time, every other one with a
+// chunked body. The latency of each request is recorded.
+//
+//   http-benchmark [host:port [connections [requests [pipeline]]]]
+//
+// Without an address, a server is started in this process on a free port of
+// 127.0.0.1.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "html2md.h"
+#include "http.h"
+#include "md4c-html.h"
+
+using std::cout;
+using std::string;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+namespace fs = std::filesystem;
+
+namespace {
+void captureHtmlFragment(const MD_CHAR *data, const MD_SIZE data_size,
+                         void *userData) {
+  static_cast<string *>(userData)->append(data, data_size);
+}
+
+// The Markdown files of the tests, as HTML
+vector<string> loadDocuments() {
+  vector<string> documents;
+
+  for (const auto &p : fs::directory_iterator(DIR)) {
+    if (p.path().extension() != ".md")
+      continue;
+
+    std::ifstream in(p.path());
+    std::stringstream md;
+    md << in.rdbuf();
+
+    string html;
+    static MD_TOC_OPTIONS options;
+    md_html(md.str().c_str(), static_cast<MD_SIZE>(md.str().size()),
+            &captureHtmlFragment, &html, MD_DIALECT_GITHUB,
+            MD_HTML_FLAG_SKIP_UTF8_BOM, &options);
+    documents.push_back(html);
+  }
+
+  return documents;
+}
+
+std::unique_ptr<Server::Connection> connectTo(const string &address) {
+  size_t colon = address.rfind(':');
+  string host = address.substr(0, colon);
+  string port = address.substr(colon + 1);
+
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+    throw std::runtime_error("Invalid address " + address);
+
+  int fd = -1;
+  for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+
+  if (fd < 0)
+    throw std::runtime_error("Can't connect to " + address);
+
+  return std::unique_ptr<Server::Connection>(new Server::Connection(fd));
+}
+
+string makeRequest(const string &html, bool chunked) {
+  string request = "POST /convert HTTP/1.1\r\nHost: localhost\r\n";
+
+  if (!chunked)
+    return request + "Content-Length: " + std::to_string(html.size()) +
+           "\r\n\r\n" + html;
+
+  // Two chunks
+  request += "Transfer-Encoding: chunked\r\n\r\n";
+  size_t half = html.size() / 2;
+  std::ostringstream chunks;
+  chunks << std::hex << half << "\r\n"
+         << html.substr(0, half) << "\r\n"
+         << html.size() - half << "\r\n"
+         << html.substr(half) << "\r\n0\r\n\r\n";
+  return request + chunks.str();
+}
+
+// Returns the body of the next response
+string receiveResponse(Server::Connection *connection) {
+  for (;;) {
+    const char *data = connection->data();
+    const char *end = std::search(data, data + connection->size(),
+                                  "\r\n\r\n", "\r\n\r\n" + 4);
+
+    if (end != data + connection->size()) {
+      string head(data, end + 4);
+      connection->consume(head.size());
+
+      if (head.compare(0, 12, "HTTP/1.1 200") != 0)
+        throw std::runtime_error(head.substr(0, head.find('\r')));
+
+      size_t length = head.find("Content-Length: ");
+      size_t size = std::stoul(head.substr(length + 16));
+      if (!connection->receive(size))
+        break;
+
+      string body(connection->data(), size);
+      connection->consume(size);
+      return body;
+    }
+
+    if (!connection->receive())
+      break;
+  }
+
+  throw std::runtime_error("Connection closed");
+}
+
+double percentile(const vector<double> &sorted, double p) {
+  size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size()));
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  string address = argc > 1 ? argv[1] : "";
+  unsigned connections =
+      argc > 2 ? static_cast<unsigned>(std::atoi(argv[2]))
+               : std::max(4u, 2 * std::thread::hardware_concurrency());
+  int requests = argc > 3 ? std::atoi(argv[3]) : 2000;
+  int pipeline = argc > 4 ? std::atoi(argv[4]) : 4;
+
+  const vector<string> documents = loadDocuments();
+  if (documents.empty() || connections == 0 || requests <= 0 ||
+      pipeline <= 0)
+    return 1;
+
+  // Start a server unless one was given
+  std::unique_ptr<Http::Protocol> protocol;
+  std::unique_ptr<Server::Server> server;
+  std::thread serving;
+  if (address.empty()) {
+    string error;
+    int fd = Http::listen("127.0.0.1:0", &error);
+    if (fd < 0) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+
+    sockaddr_in bound = {};
+    socklen_t size = sizeof(bound);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&bound), &size);
+    address = "127.0.0.1:" + std::to_string(ntohs(bound.sin_port));
+
+    protocol.reset(new Http::Protocol({}, Http::Options().maxRequestSize));
+    server.reset(new Server::Server(fd, protocol.get(), 0, {}));
+    serving = std::thread([&] { server->run(); });
+  }
+
+  vector<vector<double>> latencies(connections);
+  std::atomic<int> failures{0};
+
+  auto start = steady_clock::now();
+
+  vector<std::thread> clients;
+  for (unsigned c = 0; c < connections; ++c)
+    clients.emplace_back([&, c] {
+      try {
+        auto connection = connectTo(address);
+
+        for (int i = 0; i < requests; i += pipeline) {
+          int batch = std::min(pipeline, requests - i);
+
+          string sending;
+          for (int r = 0; r < batch; ++r) {
+            const string &html = documents[(c + i + r) % documents.size()];
+            sending += makeRequest(html, r % 2 == 1);
+          }
+
+          auto sent = steady_clock::now();
+          if (!connection->send(sending.data(), sending.size()))
+            throw std::runtime_error("Sending failed");
+
+          for (int r = 0; r < batch; ++r) {
+            string md = receiveResponse(connection.get());
+            auto received = steady_clock::now();
+
+            latencies[c].push_back(
+                duration<double, std::micro>(received - sent).count());
+
+            // Spot-check the results, like the tests
+            const string &html = documents[(c + i + r) % documents.size()];
+            if (i + r < static_cast<int>(documents.size()) &&
+                md != html2md::Convert(html))
+              ++failures;
+          }
+        }
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        ++failures;
+      }
+    });
+
+  for (auto &client : clients)
+    client.join();
+
+  double seconds = duration<double>(steady_clock::now() - start).count();
+
+  if (server) {
+    server->stop();
+    serving.join();
+  }
+
+  vector<double> all;
+  for (const auto &connection : latencies)
+    all.insert(all.end(), connection.begin(), connection.end());
+  std::sort(all.begin(), all.end());
+
+  if (all.empty())
+    return 1;
+
+  cout << "=== HTTP (" << connections << " connections, pipeline " << pipeline
+       << ", " << all.size() << " requests) ===\n";
+  cout << std::fixed << std::setprecision(1);
+  cout << "Requests/s: " << static_cast<double>(all.size()) / seconds << "\n";
+  cout << "p50: " << percentile(all, 0.50) << " us\n";
+  cout << "p90: " << percentile(all, 0.90) << " us\n";
+  cout << "p99: " << percentile(all, 0.99) << " us\n";
+  cout << "max: " << all.back() << " us\n";
+
+  if (failures != 0)
+    cout << failures << " requests failed or returned wrong Markdown\n";
+
+  return failures == 0 ? 0 : 1;
+}
@@ -4,9 +4,12 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "batch_converter.h"
 #include "html2md.h"
 #include "md4c-html.h"
 #include "table.h"
@@ -576,6 +579,368 @@ bool testPreserveNbsp() {
   return true;
 }
 
+bool testHtmlSymbolConversions() {
+  testOption("htmlSymbolConversions");
+
+  html2md::Options o;
+  o.splitLines = false;
+
+  html2md::Converter c("<p>&copy; &copy2; tm&amp;</p>", &o);
+  c.addHtmlSymbolConversion("&copy", "(c)");
+  c.addHtmlSymbolConversion("&copy2;", "(c2)");
+  c.addHtmlSymbolConversion("tm", "TM");
+
+  // The longest symbol wins, symbols don't need to start with '&'
+  if (c.convert() != "(c); (c2) TM&\n")
+    return false;
+
+  c.removeHtmlSymbolConversion("tm");
+  if (c.convert("<p>&amp;tm &copy;</p>") != "&tm (c);\n")
+    return false;
+
+  c.removeHtmlSymbolConversion("&amp;");
+  if (c.convert("<p>&amp;tm &mdash;</p>") != "&amp;tm —\n")
+    return false;
+
+  c.clearHtmlSymbolConversions();
+  return c.convert("<p>&amp;tm &mdash;</p>") == "&amp;tm &mdash;\n";
+}
+
+bool testCharacterReferences() {
+  testOption("characterReferences");
+
+  html2md::Options o;
+  o.splitLines = false;
+
+  string html = "<p>&#8217; &#x2014; &#X41; &mdash; &hellip; &NotEqualTilde; "
+                "&copy &copy; &#150; &#0; &#x110000; &unknown; &#; "
+                "<a href=\"/?a=1&copy=2&amp;b\">link</a></p>";
+  string expected = "’ — A — … ≂̸ © © – \uFFFD \uFFFD &unknown; &#; "
+                    "[link](/?a=1&copy=2&b)\n";
+
+  html2md::Converter c(html, &o);
+  if (c.convert() != expected)
+    return false;
+
+  // Decoded characters are text, never Markdown syntax
+  if (c.convert("<p>&#42;not bold&#42; and &lowbar;x&lowbar;</p>") !=
+      "\\*not bold\\* and \\_x\\_\n")
+    return false;
+
+  if (c.convert("<p>&#x5B;link&#x5D;(http://evil)</p>") !=
+      "\\[link\\](http://evil)\n")
+    return false;
+
+  // Like a line break in the HTML, it doesn't start a new Markdown line
+  if (c.convert("<p>line&#10;# heading?</p>") !=
+      c.convert("<p>line\n# heading?</p>"))
+    return false;
+
+  if (c.convert("<table><tr><th>a</th></tr><tr><td>x &#124; y</td>"
+                "<td>z</td></tr></table>") !=
+      "| a      |\n|--------|\n| x \\| y | z |\n")
+    return false;
+
+  // Widths are measured after decoding
+  if (c.convert("<table><tr><th>a</th></tr><tr><td>x&mdash;y</td></tr>"
+                "<tr><td>abc</td></tr></table>") !=
+      "| a   |\n|-----|\n| x—y |\n| abc |\n")
+    return false;
+
+  // A reference split between two chunks
+  c.feed("<p>a&#4");
+  c.feed("2;b&md");
+  c.feed("ash;c&co");
+  return c.finish() == "a\\*b—c&co\n";
+}
+
+bool testAttributes() {
+  testOption("attributes");
+
+  // Only whole attribute names match, the first of repeated ones wins
+  if (html2md::Convert("<a data-title=\"no\" href=\"x\" title=\"t\" "
+                       "title=\"u\">a</a>") != "[a](x \"t\")\n")
+    return false;
+
+  if (html2md::Convert("<img srcset=\"s 2x\" SRC='real.png' Alt = \"a b\">") !=
+      "![a b](real.png)\n")
+    return false;
+
+  // Unquoted values end at whitespace
+  return html2md::Convert("<a href=page.html title=t>a</a>") ==
+         "[a](page.html \"t\")\n";
+}
+
+bool testDeepNesting() {
+  testOption("deepNesting");
+
+  // More levels than fit into a byte
+  string html;
+  for (int i = 0; i < 300; ++i)
+    html += "<blockquote>";
+  html += "deep";
+  for (int i = 0; i < 300; ++i)
+    html += "</blockquote>";
+
+  string prefix;
+  for (int i = 0; i < 300; ++i)
+    prefix += "> ";
+
+  html2md::Options options;
+  options.splitLines = false;
+
+  html2md::Converter c(html, &options);
+  if (c.convert().find(prefix + "deep") == string::npos || !c.ok())
+    return false;
+
+  // Closing more levels than were opened
+  if (html2md::Convert("</blockquote>\ntext</blockquote>").find('>') !=
+      string::npos)
+    return false;
+
+  // The outer list continues its numbering after a nested one
+  return html2md::Convert("<ol><li>a<ol><li>b</li><li>c</li></ol></li>"
+                          "<li>d</li></ol>")
+             .find("2. d") != string::npos;
+}
+
+bool testBorrowedInput() {
+  testOption("borrowedInput");
+
+  string html = "<h1>Title</h1><p>Some <b>bold</b> text</p>";
+  string expected = html2md::Convert(html);
+
+  // Only the first bytes are HTML, the rest must be ignored
+  string buffer = html + "<p>not part of the input</p>";
+
+  html2md::Converter borrowed(buffer.data(), html.size());
+  html2md::Converter view(std::string_view(buffer).substr(0, html.size()));
+
+  return borrowed.convert() == expected && view.convert() == expected;
+}
+
+bool testReuse() {
+  testOption("reuse");
+
+  // The first document leaves the converter inside a list and a table
+  string first = "<ul><li>one<li>two<table><tr><td>cell";
+  string second = "<h1>Title</h1><p>Some <b>bold</b> text</p>";
+
+  html2md::Converter c(first);
+  (void)c.convert();
+
+  bool ok = c.convert(second) == html2md::Convert(second) && c.ok();
+
+  // reset() without new HTML converts the same document again
+  string again = c.convert();
+  c.reset();
+  ok = ok && c.convert() == again;
+
+  c.reset(first.data(), first.size());
+  return ok && c.convert() == html2md::Convert(first);
+}
+
+bool testStreaming() {
+  testOption("streaming");
+
+  string html = "<h1>Title</h1><p>Some <b>bold</b> text &amp; "
+                "<a href=\"https://example.com\" title=\"Example\">a "
+                "link</a></p><ul><li>one</li><li>two</li></ul>";
+  string expected = html2md::Convert(html);
+
+  // Every chunk size, so tags, attributes and entities get split everywhere
+  for (size_t chunk = 1; chunk <= html.size(); ++chunk) {
+    html2md::Converter c;
+    for (size_t i = 0; i < html.size(); i += chunk)
+      c.feed(html.substr(i, chunk));
+
+    if (c.finish() != expected || !c.ok())
+      return false;
+  }
+
+  return true;
+}
+
+bool testSink() {
+  testOption("sink");
+
+  string html;
+  for (int i = 0; i < 100; ++i)
+    html += "<h2>Part " + std::to_string(i) +
+            "</h2><p>Some <b>bold</b> text &amp; more.</p><ul><li>one</li>"
+            "<li>two</li></ul><table><tr><th>A</th><th>B</th></tr><tr><td>"
+            "1</td><td>2</td></tr></table><pre><code>code\n  "
+            "indented</code></pre>";
+  string expected = html2md::Convert(html);
+
+  string written;
+  size_t parts = 0;
+  html2md::CallbackSink sink([&](const char *data, size_t size) {
+    written.append(data, size);
+    ++parts;
+  });
+
+  // A small threshold to flush as often as possible
+  html2md::Converter c(html);
+  c.setSink(&sink, 64);
+
+  return c.convert().empty() && written == expected && parts > 1;
+}
+
+bool testBatchConverter() {
+  testOption("batchConverter");
+
+  // A few huge documents between many small ones
+  vector<string> inputs;
+  for (int i = 0; i < 200; ++i) {
+    string html = "<h2>Page " + std::to_string(i) + "</h2><p>Some <b>bold</b> "
+                  "text &amp; a <a href=\"#\">link</a></p>";
+    if (i % 50 == 0)
+      for (int j = 0; j < 2000; ++j)
+        html += "<ul><li>item " + std::to_string(j) + "</li></ul>";
+    inputs.push_back(html);
+  }
+
+  vector<string> expected;
+  for (const auto &html : inputs)
+    expected.push_back(html2md::Convert(html));
+
+  html2md::BatchConverter batch(4);
+  if (batch.convert(inputs) != expected)
+    return false;
+
+  // The callback gets the results in input order
+  size_t next = 0;
+  bool in_order = true;
+  batch.convert(inputs.data(), inputs.size(), [&](size_t index, string &&md) {
+    in_order = in_order && index == next++ && md == expected[index];
+  });
+  if (!in_order || next != inputs.size())
+    return false;
+
+  // convert() returns only after the last callback did, and rethrows what it
+  // threw
+  bool finished = false;
+  const string small = "<p>small</p>";
+  try {
+    batch.convert(&small, 1, [&](size_t, string &&) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      finished = true;
+      throw std::runtime_error("callback");
+    });
+    return false;
+  } catch (const std::runtime_error &) {
+    if (!finished)
+      return false;
+  }
+
+  auto futures = batch.submit(inputs.data(), inputs.size());
+  for (size_t i = 0; i < futures.size(); ++i)
+    if (futures[i].get() != expected[i])
+      return false;
+
+  return true;
+}
+
+bool testConvertParallel() {
+  testOption("convertParallel");
+
+  // Code blocks, tables and nested lists across the part boundaries
+  string html;
+  for (int i = 0; html.size() < 3 * 1024 * 1024; ++i) {
+    html += "<h2>Part " + std::to_string(i) + "</h2><p>Some <b>bold</b> "
+            "text &amp; a <a href=\"#\">link</a> , done</p>";
+    if (i % 7 == 0)
+      html += "<pre><code>int i = " + std::to_string(i) + ";\n</code></pre>";
+    if (i % 11 == 0)
+      html += "<table><tr><th>A</th><th>B</th></tr><tr><td>1</td><td>" +
+              std::to_string(i) + "</td></tr></table>";
+    if (i % 13 == 0)
+      html += "<ol><li>one<ul><li>nested</li></ul></li><li>two</li></ol>";
+    if (i % 17 == 0)
+      html += "<blockquote>quote<p>more</p></blockquote>";
+  }
+
+  string expected = html2md::Convert(html);
+
+  for (unsigned threads : {1u, 2u, 3u, 8u}) {
+    html2md::Converter c(html);
+    if (c.convertParallel(threads) != expected)
+      return false;
+  }
+
+  return true;
+}
+
+bool testTableSampleRows() {
+  testOption("tableSampleRows");
+
+  string html = "<table><tr><th>Name</th><th>Value</th></tr>";
+  for (int i = 0; i < 1000; ++i)
+    html += "<tr><td>row " + std::to_string(i) + "</td><td>" +
+            std::to_string(i) + "</td></tr>";
+  html += "<tr><td>a much longer name</td><td>1</td></tr></table>";
+
+  // Measuring enough rows gives the same table as measuring all of them
+  html2md::Options options;
+  options.tableSampleRows = 2000;
+  if (html2md::Converter(html, &options).convert() != html2md::Convert(html))
+    return false;
+
+  // Measure on a few rows and stream the rest to a sink. Rows are written
+  // while the table is still open.
+  options.tableSampleRows = 10;
+
+  string written;
+  size_t written_before_close = 0;
+  html2md::CallbackSink sink(
+      [&](const char *data, size_t size) { written.append(data, size); });
+
+  html2md::Converter c(&options);
+  c.setSink(&sink, 256);
+  c.feed(html.substr(0, html.size() - 8));
+  written_before_close = written.size();
+  c.feed(html.substr(html.size() - 8));
+  c.finish();
+
+  if (written_before_close < written.size() / 2)
+    return false;
+
+  // Every row has the same columns, the long cell is not padded
+  std::istringstream lines(written);
+  string line;
+  size_t rows = 0;
+  while (std::getline(lines, line)) {
+    if (line.empty())
+      continue;
+
+    ++rows;
+    if (std::count(line.begin(), line.end(), '|') != 3)
+      return false;
+  }
+
+  if (rows != 1003 || written.find("| row 5 | 5     |") == string::npos ||
+      written.find("| a much longer name | 1     |") == string::npos)
+    return false;
+
+  // A closing tag without an open table is ignored, also after the Markdown
+  // in front of it was flushed
+  string stray = html;
+  for (int i = 0; i < 2000; ++i)
+    stray += "<p>paragraph " + std::to_string(i) + "</p>";
+  string expected = html2md::Convert(stray);
+
+  if (html2md::Convert(stray + "</table>") != expected)
+    return false;
+
+  written.clear();
+  c.setSink(&sink, 256);
+  c.feed(stray + "</table>");
+  c.finish();
+
+  return written == html2md::Converter(stray, &options).convert();
+}
+
 int main(int argc, const char **argv) {
   // List to store all markdown files in this dir
   vector<string> files;
@@ -640,6 +1005,17 @@ int main(int argc, const char **argv) {
                 &testEscapingNumberedList,
                 &testTableFormatting,
                 &testPreserveNbsp,
+                &testHtmlSymbolConversions,
+                &testCharacterReferences,
+                &testAttributes,
+                &testDeepNesting,
+                &testBorrowedInput,
+                &testReuse,
+                &testStreaming,
+                &testSink,
+                &testTableSampleRows,
+                &testBatchConverter,
+                &testConvertParallel,
               };
 
   for (const auto &test : tests)
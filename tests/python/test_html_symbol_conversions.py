@@ -15,21 +15,21 @@ def test_add_html_symbol_conversion():
     """Test adding new HTML symbol conversions"""
     converter = pyhtml2md.Converter("&copy; &reg; &custom;")
     
-    # Before adding conversions
+    # Before adding conversions, only character references are decoded
     result = converter.convert()
-    assert "&copy;" in result
-    assert "&reg;" in result
+    assert "©" in result
+    assert "®" in result
     assert "&custom;" in result
     
     # Add new conversions
     converter = pyhtml2md.Converter("&copy; &reg; &custom;")
-    converter.add_html_symbol_conversion("&copy;", "©")
-    converter.add_html_symbol_conversion("&reg;", "®")
+    converter.add_html_symbol_conversion("&copy;", "(c)")
+    converter.add_html_symbol_conversion("&reg;", "(r)")
     converter.add_html_symbol_conversion("&custom;", "CUSTOM")
     
     result = converter.convert()
-    assert "©" in result
-    assert "®" in result
+    assert "(c)" in result
+    assert "(r)" in result
     assert "CUSTOM" in result
 
 def test_modify_html_symbol_conversion():
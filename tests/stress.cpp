@@ -0,0 +1,138 @@
+// Copyright (c) Tim Gromeyer
+// Licensed under the MIT License - https://opensource.org/licenses/MIT
+
+// Converts the same documents from many threads at once and compares the
+// results with a single-threaded run. Build with -DBUILD_TSAN=ON to run it
+// under ThreadSanitizer.
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "batch_converter.h"
+#include "html2md.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+constexpr int kIterations = 50;
+
+vector<string> makeDocuments() {
+  vector<string> documents = {
+      "<h1>Title</h1><p>Some <b>bold</b> and <i>italic</i> text &amp; "
+      "&copy; &#8217; &mdash;.</p>",
+      "<ul><li>one</li><li>two<ol><li>nested</li></ol></li></ul>",
+      "<table><tr><th align=\"right\">A</th><th>B</th></tr><tr><td>1</td>"
+      "<td>22</td></tr></table>",
+      "<a href=\"http://example.com/\" title=\"t\">link</a> <img alt=\"a\" "
+      "src=\"b.png\">",
+      "<pre><code class=\"language-cpp\">int main() {\n  return 0;\n}"
+      "</code></pre>",
+      "<blockquote>quote<blockquote>nested</blockquote></blockquote>",
+      // Whitespace inside tags
+      "< p >spaced</ p><br/><hr /><span\nclass=\"x\">y</span>",
+  };
+
+  // A larger document that gets flushed to a sink several times
+  string large;
+  for (int i = 0; i < 200; ++i)
+    large += documents[static_cast<size_t>(i) % documents.size()];
+  documents.push_back(large);
+
+  return documents;
+}
+} // namespace
+
+int main() {
+  const vector<string> documents = makeDocuments();
+
+  // Reference results from a single thread
+  vector<string> expected;
+  for (const auto &html : documents)
+    expected.push_back(html2md::Convert(html));
+
+  unsigned threads = std::thread::hardware_concurrency();
+  if (threads < 4)
+    threads = 4;
+
+  std::atomic<int> failures{0};
+
+  auto check = [&](const string &md, size_t document, const char *mode) {
+    if (md == expected[document])
+      return;
+
+    ++failures;
+    std::cerr << mode << ": wrong result for document " << document << "\n";
+  };
+
+  // All threads share one BatchConverter
+  html2md::BatchConverter batch(threads);
+
+  auto work = [&](unsigned thread) {
+    // Every thread reuses its own instance as well
+    html2md::Converter converter;
+
+    for (int i = 0; i < kIterations; ++i) {
+      for (size_t d = 0; d < documents.size(); ++d) {
+        // Start at a different document in every thread
+        size_t document = (d + thread) % documents.size();
+        const string &html = documents[document];
+
+        switch ((i + thread) % 5) {
+        case 0:
+          check(html2md::Convert(html), document, "Convert()");
+          break;
+        case 1:
+          check(converter.convert(html), document, "convert(html)");
+          break;
+        case 2: {
+          auto futures = batch.submit(documents.data(), documents.size());
+          for (size_t f = 0; f < futures.size(); ++f)
+            check(futures[f].get(), f, "BatchConverter");
+          break;
+        }
+        case 3: {
+          // The callback runs on the workers, convert() waits for all of them
+          vector<string> results(documents.size());
+          batch.convert(documents.data(), documents.size(),
+                        [&](size_t index, string &&md) {
+                          results[index] = std::move(md);
+                        });
+          for (size_t r = 0; r < results.size(); ++r)
+            check(results[r], r, "BatchConverter::convert()");
+          break;
+        }
+        default: {
+          string md;
+          html2md::CallbackSink sink(
+              [&](const char *data, size_t size) { md.append(data, size); });
+
+          html2md::Converter streaming;
+          streaming.setSink(&sink, 256);
+          for (size_t pos = 0; pos < html.size(); pos += 97)
+            streaming.feed(html.substr(pos, 97));
+          md += streaming.finish();
+
+          check(md, document, "feed()");
+        }
+        }
+      }
+    }
+  };
+
+  vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; ++t)
+    pool.emplace_back(work, t);
+
+  for (auto &thread : pool)
+    thread.join();
+
+  std::cout << threads << " threads, " << documents.size() * kIterations
+            << " conversions each: " << failures << " failed.\n";
+
+  return failures == 0 ? 0 : 1;
+}